@@ -6,45 +6,169 @@
 /* Kenneth C. Louden                                */
 /****************************************************/
 
+#include <stdarg.h>
 #include "globals.h"
 #include "symtab.h"
 #include "analyze.h"
 #include "util.h"
+#include "parallel.h"
+#include "events.h"
+
+/* DiagBuffer holds diagnostics that are written to
+ * the listing later, so that the single-pass analyzer
+ * can emit them in the order of the two-pass one.
+ * lines marks where the line numbers are in the text
+ */
+typedef struct
+{
+    char* text;
+    int size;
+    int capacity;
+    DiagLine* lines;
+    int lineCount;
+    int lineCapacity;
+} DiagBuffer;
+
+/* diagnostics is the buffer errors go to;
+ * NULL writes them straight to the listing.
+ * Like the rest of the checker state it is per
+ * thread, since typeCheck may run on several
+ */
+static _Thread_local DiagBuffer* diagnostics = NULL;
+
+/* buildErrors counts the errors found while
+ * building the symbol table
+ */
+static int buildErrors = 0;
+
+/* Procedure reserve makes room in buffer for n more
+ * characters and a terminating null
+ */
+static void reserve(DiagBuffer* buffer, int n)
+{
+    if (buffer->size + n + 1 > buffer->capacity)
+    {
+        int capacity = buffer->capacity ? buffer->capacity : 256;
+        while (buffer->size + n + 1 > capacity)
+            capacity *= 2;
+        buffer->text = (char*)realloc(buffer->text, capacity);
+        if (buffer->text == NULL)
+        {
+            fprintf(listing, "Out of memory error at line %d\n", lineno);
+            exit(1);
+        }
+        buffer->capacity = capacity;
+    }
+}
+
+static void vreport(const char* format, va_list ap)
+{
+    va_list copy;
+    int n;
+    if (diagnostics == NULL)
+    {
+        Error = TRUE;
+        vfprintf(listing, format, ap);
+        return;
+    }
+    va_copy(copy, ap);
+    n = vsnprintf(NULL, 0, format, copy);
+    va_end(copy);
+    reserve(diagnostics, n);
+    vsnprintf(diagnostics->text + diagnostics->size, n + 1, format, ap);
+    diagnostics->size += n;
+}
+
+static void report(const char* format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vreport(format, ap);
+    va_end(ap);
+}
+
+/* Procedure reportLine reports the line number
+ * lineno, marking where it is in the buffer
+ */
+static void reportLine(int lineno)
+{
+    if (diagnostics != NULL)
+    {
+        if (diagnostics->lineCount == diagnostics->lineCapacity)
+        {
+            diagnostics->lineCapacity = diagnostics->lineCapacity ? 2 * diagnostics->lineCapacity : 8;
+            diagnostics->lines = (DiagLine*)realloc(
+                diagnostics->lines, diagnostics->lineCapacity * sizeof(DiagLine));
+            if (diagnostics->lines == NULL)
+            {
+                fprintf(listing, "Out of memory error at line %d\n", lineno);
+                exit(1);
+            }
+        }
+        diagnostics->lines[diagnostics->lineCount].offset = diagnostics->size;
+        diagnostics->lines[diagnostics->lineCount++].lineno = lineno;
+    }
+    report("%d", lineno);
+}
+
+/* Procedure reportAt reports an error of kind at
+ * lineno, followed by the formatted message
+ */
+static void reportAt(int lineno, const char* kind, const char* format, ...)
+{
+    va_list ap;
+    report("%s at line ", kind);
+    reportLine(lineno);
+    report(": ");
+    va_start(ap, format);
+    vreport(format, ap);
+    va_end(ap);
+}
+
+/* Procedure reportText reports size characters of
+ * diagnostics that were formatted before
+ */
+static void reportText(const char* text, int size)
+{
+    if (size == 0)
+        return;
+    if (diagnostics == NULL)
+    {
+        Error = TRUE;
+        fwrite(text, 1, size, listing);
+        return;
+    }
+    reserve(diagnostics, size);
+    memcpy(diagnostics->text + diagnostics->size, text, size);
+    diagnostics->size += size;
+    diagnostics->text[diagnostics->size] = '\0';
+}
 
 static void typeError(TreeNode* t, char* message)
 {
-    fprintf(listing, "Type error at line %d: %s\n", t->lineno, message);
-    Error = TRUE;
+    reportAt(t->lineno, "Type error", "%s\n", message);
 }
 
 static void undeclaredError(TreeNode* t)
 {
-    fprintf(listing,
-            "Undeclared error at line %d: '%s' undeclared\n",
-            t->lineno,
-            t->attr.name);
-    Error = TRUE;
+    reportAt(t->lineno, "Undeclared error", "'%s' undeclared\n", t->attr.name);
 }
 
 static void redeclaredError(TreeNode* t)
 {
-    fprintf(listing,
-            "Redeclared error at line %d: '%s' redeclared\n",
-            t->lineno,
-            t->attr.name);
-    Error = TRUE;
+    reportAt(t->lineno, "Redeclared error", "'%s' redeclared\n", t->attr.name);
+    ++buildErrors;
 }
 
 static void declarationError(TreeNode* t, char* message)
 {
-    fprintf(listing, "declaration error at line %d: %s\n", t->lineno, message);
-    Error = TRUE;
+    reportAt(t->lineno, "declaration error", "%s\n", message);
+    ++buildErrors;
 }
 
 static void argCountError(TreeNode* t, char* funcName, int paramCount, int argCount)
 {
-    fprintf(listing, "function call error at line %d: The %s function has %d parameters, but only %d entered.\n", t->lineno, funcName, paramCount, argCount);
-    Error = TRUE;
+    reportAt(t->lineno, "function call error", "The %s function has %d parameters, but only %d entered.\n", funcName, paramCount, argCount);
 }
 
 /* Procedure traverse is a generic recursive
@@ -68,6 +192,19 @@ traverse(TreeNode* t, void (*preProc)(TreeNode*), void (*postProc)(TreeNode*))
     }
 }
 
+/* Procedure traverseNode is traverse restricted to
+ * t and its children, leaving out t's siblings
+ */
+static void
+traverseNode(TreeNode* t, void (*preProc)(TreeNode*), void (*postProc)(TreeNode*))
+{
+    int i;
+    preProc(t);
+    for (i = 0; i < MAXCHILDREN; i++)
+        traverse(t->child[i], preProc, postProc);
+    postProc(t);
+}
+
 /* nullProc is a do-nothing procedure to
  * generate preorder-only or postorder-only
  * traversals from traverse
@@ -86,8 +223,8 @@ typedef struct
     int location;
 } ScopeStackPair;
 
-static ScopeStackPair scope_stack[MAXSCOPEDEPTH];
-static int scope_stack_top_index = -1;
+static _Thread_local ScopeStackPair scope_stack[MAXSCOPEDEPTH];
+static _Thread_local int scope_stack_top_index = -1;
 int scope_stack_push(ScopeList scope, int location)
 {
     if (scope_stack_top_index >= MAXSCOPEDEPTH - 1)
@@ -124,7 +261,7 @@ static int built_in_functions(ScopeList scope, int location)
         param.isarray = FALSE;
         param.attr.name = "";
         param.type = Integer;
-        addFuncArg(output, &param);
+        addFuncArg(scope, output, &param);
     }
 
     // input
@@ -134,17 +271,53 @@ static int built_in_functions(ScopeList scope, int location)
     return location;
 }
 
-static ScopeList init_global_scope()
+/* current_symtab is the version being built or checked */
+static _Thread_local Symtab current_symtab;
+
+static void init_global_scope(Symtab tab)
 {
-    static ScopeList global_scope;
-    static int global_scope_location;
-    global_scope = create_ScopeList(NULL, "global");
-    global_scope_location = built_in_functions(global_scope, 0);
-    scope_stack_push(global_scope, global_scope_location);
-    return global_scope;
+    int global_scope_location = built_in_functions(tab->global, 0);
+    scope_stack_top_index = -1;
+    scope_stack_push(tab->global, global_scope_location);
 }
 
 static BucketList current_function;
+
+/* current_declaration is the declaration of the
+ * function being analyzed
+ */
+static _Thread_local TreeNode* current_declaration;
+
+/* signatures_declared is TRUE once every global
+ * and function signature is in the global scope
+ */
+static int signatures_declared = FALSE;
+
+/* Procedure declareFunction enters function t and
+ * the types of its parameters into the global scope
+ */
+static void declareFunction(TreeNode* t, ScopeStackPair* pair)
+{
+    TreeNode* param;
+    current_function = st_insert(pair->scope,
+                                 t->attr.name,
+                                 t->type,
+                                 t->isarray,
+                                 FuncSymbol,
+                                 t->lineno,
+                                 pair->location++);
+    if (!current_function)
+    {
+        redeclaredError(t);
+    }
+    for (param = t->child[0]; param != NULL; param = param->sibling)
+    {
+        if (param->kind.declaration == ParameterK && current_function)
+        {
+            addFuncArg(pair->scope, current_function, param);
+        }
+    }
+}
 /* Procedure insertNode inserts
  * identifiers stored in t into
  * the symbol table
@@ -165,11 +338,10 @@ static void insertNode(TreeNode* t)
 
                 case CallK:
                 case VarK:
-                    if (st_insert_lineno(pair->scope, t->attr.name, t->lineno))
-                    {
-                        // t->type = Invalid;
-                        // undeclaredError(t);
-                    }
+                    /* names of globals declared further down
+                     * stay NULL and are resolved by checkNode
+                     */
+                    t->symbol = st_insert_lineno(current_symtab, pair->scope, t->attr.name, t->lineno);
                     break;
                 default:
                     break;
@@ -181,10 +353,8 @@ static void insertNode(TreeNode* t)
                 case CompoundK:
                     if (!is_func_compound)
                     {
-                        char buf[101];
-                        snprintf(buf, 100, "%s_%d", pair->scope->name, t->lineno);
                         ScopeList newScope =
-                            create_ScopeList(pair->scope, copyString(buf));
+                            create_BlockScope(pair->scope, t->lineno);
                         scope_stack_push(newScope, 0);
                         t->scope = newScope;
                         pair->location++;
@@ -202,27 +372,21 @@ static void insertNode(TreeNode* t)
             switch (t->kind.declaration)
             {
                 case FuncK:
-                    if (pair->scope->parent) // not global scope
+                    if (pair->scope != current_symtab->global)
                     {
-                        printf("%s\n", pair->scope->name);
+                        printf("%s\n", st_scope_name(pair->scope));
                         declarationError(
                             t,
                             "Functions can only be declared in global scope.");
                         break;
                     }
-                    current_function = st_insert(pair->scope,
-                                                 t->attr.name,
-                                                 t->type,
-                                                 t->isarray,
-                                                 FuncSymbol,
-                                                 t->lineno,
-                                                 pair->location++);
-                    if (!current_function)
+                    if (!signatures_declared)
                     {
-                        redeclaredError(t);
+                        declareFunction(t, pair);
                     }
-                    ScopeList newScope =
-                        create_ScopeList(pair->scope, t->attr.name);
+                    current_declaration = t;
+                    /* every function gets a scope table of its own */
+                    ScopeList newScope = create_ScopeList(NULL, t->attr.name);
                     scope_stack_push(newScope, 0);
                     t->scope = newScope;
                     is_func_compound = TRUE;
@@ -250,7 +414,6 @@ static void insertNode(TreeNode* t)
                     {
                         redeclaredError(t);
                     }
-                    addFuncArg(current_function, t);
                     break;
                 case VoidParameterK:
                 default:
@@ -269,18 +432,253 @@ static void afterInsertNode(TreeNode* t)
     }
 }
 
+/* FNV-1a step used by hashTree */
+static unsigned long hashMix(unsigned long h, unsigned long v)
+{
+    return (h ^ v) * 1099511628211UL;
+}
+
+static unsigned long hashString(unsigned long h, const char* s)
+{
+    while (*s)
+        h = hashMix(h, (unsigned char)*s++);
+    return hashMix(h, 0);
+}
+
+/* Function hashTree hashes the syntax tree list t,
+ * with its lines counted from base. It only reads
+ * what the parser sets, so the hash of a tree is the
+ * same before and after type checking, and the same
+ * wherever the tree is in the source
+ */
+static unsigned long hashTree(TreeNode* t, unsigned long h, int base)
+{
+    int i;
+    for (; t != NULL; t = t->sibling)
+    {
+        h = hashMix(h, t->nodekind);
+        h = hashMix(h, t->lineno - base);
+        switch (t->nodekind)
+        {
+            case StmtK:
+                h = hashMix(h, t->kind.stmt);
+                break;
+            case ExpK:
+                h = hashMix(h, t->kind.exp);
+                if (t->kind.exp == OperatorK)
+                    h = hashMix(h, t->attr.op);
+                else if (t->kind.exp == ConstantK)
+                    h = hashMix(h, t->attr.val);
+                else if (t->kind.exp == CallK || t->kind.exp == VarK)
+                    h = hashString(h, t->attr.name);
+                break;
+            case DeclarationK:
+                h = hashMix(h, t->kind.declaration);
+                h = hashMix(h, t->type);
+                h = hashMix(h, t->isarray);
+                if (t->kind.declaration != VoidParameterK)
+                    h = hashString(h, t->attr.name);
+                break;
+            default:
+                break;
+        }
+        for (i = 0; i < MAXCHILDREN; i++)
+            h = hashTree(t->child[i], hashMix(h, 0x100 + i), base);
+        h = hashMix(h, 0x1ff);
+    }
+    return h;
+}
+
+static unsigned long hashFunction(TreeNode* t)
+{
+    TreeNode* sibling = t->sibling;
+    unsigned long h;
+    t->sibling = NULL;
+    h = hashTree(t, 14695981039346656037UL, t->lineno);
+    t->sibling = sibling;
+    return h;
+}
+
+/* UnitIndex finds the function scope tables of the
+ * previous version by the hash of their declaration.
+ * A slot holds the number of a table in previous
+ * plus one, or 0
+ */
+typedef struct
+{
+    Symtab previous;
+    int* slots;
+    int mask;
+} UnitIndex;
+
+static void indexUnits(UnitIndex* index, Symtab previous)
+{
+    int size = 16, i;
+    index->previous = previous;
+    index->slots = NULL;
+    index->mask = 0;
+    if (previous == NULL || previous->unitCount == 0)
+        return;
+    while (size < previous->unitCount * 2)
+        size *= 2;
+    index->slots = (int*)calloc(size, sizeof(int));
+    if (index->slots == NULL)
+    {
+        fprintf(listing, "Out of memory error at line %d\n", lineno);
+        exit(1);
+    }
+    index->mask = size - 1;
+    for (i = 0; i < previous->unitCount; ++i)
+    {
+        ScopeTable unit = previous->units[i];
+        int j = (int)(unit->hash & index->mask);
+        if (!unit->clean)
+            continue;
+        while (index->slots[j])
+            j = (j + 1) & index->mask;
+        index->slots[j] = i + 1;
+    }
+}
+
+/* Function findUnit returns the number of the table
+ * of the previous version that function name with
+ * the given hash can share, or -1
+ */
+static int findUnit(UnitIndex* index, char* name, unsigned long hash)
+{
+    int j;
+    if (index->slots == NULL)
+        return -1;
+    for (j = (int)(hash & index->mask); index->slots[j]; j = (j + 1) & index->mask)
+    {
+        ScopeTable unit = index->previous->units[index->slots[j] - 1];
+        if (unit->hash == hash && (unit->xref || !st_xref_enabled()) &&
+            strcmp(unit->scopes[0]->name, name) == 0)
+        {
+            return index->slots[j] - 1;
+        }
+    }
+    return -1;
+}
+
+/* Procedure assignScopes points the compound
+ * statements of t, in preorder, at the block scopes
+ * of a shared function table, and clears symbols
+ * resolved against an earlier version
+ */
+static void assignScopes(TreeNode* t, ScopeTable unit, int* next)
+{
+    int i;
+    for (; t != NULL; t = t->sibling)
+    {
+        t->symbol = NULL;
+        if (t->nodekind == StmtK && t->kind.stmt == CompoundK)
+        {
+            t->scope = unit->scopes[(*next)++];
+        }
+        for (i = 0; i < MAXCHILDREN; i++)
+            assignScopes(t->child[i], unit, next);
+    }
+}
+
+/* Procedure reuseFunction enters function t into the
+ * global scope and shares the k-th table of the
+ * previous version, built for an identical
+ * declaration, with the result of its last check.
+ * The table keeps its lines; the version moves them
+ * to where t is
+ */
+static void reuseFunction(TreeNode* t, UnitIndex* index, int k)
+{
+    ScopeStackPair* pair = scope_stack_top();
+    ScopeTable unit = index->previous->units[k];
+    int shift = t->lineno - unit->lineno;
+    int next = 1, i;
+    if (!signatures_declared)
+    {
+        declareFunction(t, pair);
+    }
+    t->scope = unit->scopes[0];
+    if (t->child[1])
+    {
+        for (i = 0; i < MAXCHILDREN; i++)
+            assignScopes(t->child[1]->child[i], unit, &next);
+    }
+    for (i = 0; st_xref_enabled() && i < unit->externCount; ++i)
+    {
+        st_insert_lineno(current_symtab, pair->scope, unit->externs[i].name, unit->externs[i].lineno + shift);
+    }
+    st_add_unit(current_symtab, unit, shift);
+    st_set_check(current_symtab, current_symtab->unitCount - 1, index->previous->checks[k]);
+}
+
+/* Function insertFunction builds the scope table of
+ * function t by a traversal with preProc and postProc,
+ * or shares the previous one if the declaration did
+ * not change. It returns TRUE if the table is shared.
+ * Either way the table is the last of the version
+ */
+static int insertFunction(TreeNode* t,
+                          UnitIndex* index,
+                          void (*preProc)(TreeNode*),
+                          void (*postProc)(TreeNode*))
+{
+    unsigned long hash = hashFunction(t);
+    int k = findUnit(index, t->attr.name, hash);
+    int errors = buildErrors;
+    ScopeTable unit;
+    if (k >= 0)
+    {
+        reuseFunction(t, index, k);
+        return TRUE;
+    }
+    ev_begin("function", t->attr.name);
+    traverseNode(t, preProc, postProc);
+    unit = t->scope->table;
+    unit->hash = hash;
+    unit->lineno = t->lineno;
+    unit->clean = buildErrors == errors;
+    st_add_unit(current_symtab, unit, 0);
+    /* the version now holds the table */
+    st_destroy(t->scope);
+    ev_end();
+    return FALSE;
+}
+
 /* Function buildSymtab constructs the symbol
- * table by preorder traversal of the syntax tree
+ * table by preorder traversal of the syntax tree.
+ * Functions whose declaration is identical to one
+ * in previous (which may be NULL) share its table
  */
-void buildSymtab(TreeNode* syntaxTree)
+Symtab buildSymtab(TreeNode* syntaxTree, Symtab previous)
 {
-    ScopeList global_scope = init_global_scope();
-    traverse(syntaxTree, insertNode, afterInsertNode);
+    UnitIndex index;
+    TreeNode* t;
+    if (TraceAnalyze)
+    {
+        st_set_xref(TRUE);
+    }
+    current_symtab = st_create();
+    init_global_scope(current_symtab);
+    indexUnits(&index, previous);
+    for (t = syntaxTree; t != NULL; t = t->sibling)
+    {
+        if (t->nodekind == DeclarationK && t->kind.declaration == FuncK)
+        {
+            insertFunction(t, &index, insertNode, afterInsertNode);
+        }
+        else
+        {
+            traverseNode(t, insertNode, afterInsertNode);
+        }
+    }
+    free(index.slots);
     if (TraceAnalyze)
     {
-        printSymTab(listing, global_scope);
-        printFuncTab(listing, global_scope);
+        printSymTab(listing, current_symtab);
+        printFuncTab(listing, current_symtab);
     }
+    return current_symtab;
 }
 
 static void beforeCheckNode(TreeNode* t)
@@ -320,7 +718,7 @@ static void beforeCheckNode(TreeNode* t)
             {
                 case FuncK:
                     scope_stack_push(t->scope, 0);
-                    current_function = st_lookup(t->scope, t->attr.name);
+                    current_declaration = t;
                     break;
                 case VarDeclarationK:
                 case ParameterK:
@@ -348,6 +746,287 @@ static void beforeCheckNode(TreeNode* t)
 – Note: C-minus Type  void, int, int[]
 */
 
+/* DepSet collects the dependencies of the function
+ * being checked, one per global name
+ */
+typedef struct
+{
+    Dependency* slots;
+    int mask;
+    int count;
+} DepSet;
+
+/* dependencies is the set of the function being
+ * checked, or NULL when none is recorded
+ */
+static _Thread_local DepSet* dependencies = NULL;
+
+/* Function signatureHash hashes what type checking
+ * reads from a global declaration, 0 standing for
+ * an undeclared name
+ */
+static unsigned long signatureHash(BucketList symbol)
+{
+    unsigned long h = 14695981039346656037UL;
+    FunctionArgsList arg;
+    if (symbol == NULL)
+        return 0;
+    h = hashMix(h, symbol->kind);
+    h = hashMix(h, symbol->type);
+    h = hashMix(h, symbol->isarray);
+    h = hashMix(h, symbol->functionInfo.args_count);
+    for (arg = symbol->functionInfo.args; arg != NULL; arg = arg->next)
+    {
+        h = hashMix(h, arg->type);
+        h = hashMix(h, arg->isarray);
+    }
+    return h ? h : 1;
+}
+
+static Dependency* allocDependencies(int size)
+{
+    Dependency* slots = (Dependency*)calloc(size, sizeof(Dependency));
+    if (slots == NULL)
+    {
+        fprintf(listing, "Out of memory error at line %d\n", lineno);
+        exit(1);
+    }
+    return slots;
+}
+
+static void beginDependencies(DepSet* set)
+{
+    set->slots = allocDependencies(16);
+    set->mask = 15;
+    set->count = 0;
+    dependencies = set;
+}
+
+static void endDependencies(DepSet* set)
+{
+    free(set->slots);
+    dependencies = NULL;
+}
+
+static void addDependency(DepSet* set, char* name, unsigned long signature)
+{
+    int j = (int)(hashString(0, name) & set->mask);
+    while (set->slots[j].name)
+    {
+        if (strcmp(set->slots[j].name, name) == 0)
+            return;
+        j = (j + 1) & set->mask;
+    }
+    set->slots[j].name = name;
+    set->slots[j].signature = signature;
+    if (++set->count * 2 > set->mask)
+    {
+        Dependency* old = set->slots;
+        int size = set->mask + 1, i;
+        set->slots = allocDependencies(size * 2);
+        set->mask = size * 2 - 1;
+        set->count = 0;
+        for (i = 0; i < size; ++i)
+        {
+            if (old[i].name)
+                addDependency(set, old[i].name, old[i].signature);
+        }
+        free(old);
+    }
+}
+
+/* Procedure recordDependency notes that name resolved
+ * to symbol if that is a global or nothing
+ */
+static void recordDependency(char* name, BucketList symbol)
+{
+    if (dependencies == NULL)
+        return;
+    if (symbol != NULL && symbol->scope != current_symtab->global)
+        return;
+    addDependency(dependencies, name, signatureHash(symbol));
+}
+
+/* Function countNodes returns the number of
+ * expression nodes of t and its children
+ */
+static int countNodes(TreeNode* t)
+{
+    TreeNode* c;
+    int n = t->nodekind == ExpK, i;
+    for (i = 0; i < MAXCHILDREN; i++)
+        for (c = t->child[i]; c != NULL; c = c->sibling)
+            n += countNodes(c);
+    return n;
+}
+
+/* Procedure recordAnnotations stores the annotations
+ * of the expression nodes of t and its children at
+ * *next, in preorder
+ */
+static void recordAnnotations(TreeNode* t, Annotation** next)
+{
+    TreeNode* c;
+    int i;
+    if (t->nodekind == ExpK)
+    {
+        Annotation* a = (*next)++;
+        a->type = t->type;
+        a->isarray = (short)t->isarray;
+        a->global = t->symbol != NULL && t->symbol->scope == current_symtab->global;
+        a->symbol = a->global ? NULL : t->symbol;
+    }
+    for (i = 0; i < MAXCHILDREN; i++)
+        for (c = t->child[i]; c != NULL; c = c->sibling)
+            recordAnnotations(c, next);
+}
+
+/* Procedure annotate gives the expression nodes of
+ * t and its children the annotations at *next,
+ * recorded from a tree of the same shape
+ */
+static void annotate(TreeNode* t, Annotation** next)
+{
+    TreeNode* c;
+    int i;
+    if (t->nodekind == ExpK)
+    {
+        Annotation* a = (*next)++;
+        t->type = a->type;
+        t->isarray = a->isarray;
+        if (a->global)
+            t->symbol = st_resolve(current_symtab, current_symtab->global, t->attr.name);
+        else
+            t->symbol = a->symbol;
+    }
+    for (i = 0; i < MAXCHILDREN; i++)
+        for (c = t->child[i]; c != NULL; c = c->sibling)
+            annotate(c, next);
+}
+
+/* Function digits returns the length of lineno */
+static int digits(int lineno)
+{
+    return snprintf(NULL, 0, "%d", lineno);
+}
+
+/* Procedure saveCheck makes the dependencies, the
+ * diagnostics and the annotations of the check just
+ * done of function t the result of the slot-th
+ * function of the version
+ */
+static void saveCheck(TreeNode* t, int slot, DepSet* set)
+{
+    CheckResult result;
+    Annotation* next;
+    char* text;
+    size_t size;
+    int nodes = countNodes(t), i, n = 0, from = 0, textSize = diagnostics->size;
+    for (i = 0; i < diagnostics->lineCount; ++i)
+        textSize -= digits(diagnostics->lines[i].lineno);
+    size = sizeof(struct CheckResultRec) + nodes * sizeof(Annotation) +
+           set->count * sizeof(Dependency) + diagnostics->lineCount * sizeof(DiagLine) + textSize + 1;
+    for (i = 0; i <= set->mask; ++i)
+        if (set->slots[i].name)
+            size += strlen(set->slots[i].name) + 1;
+    result = (CheckResult)mt_malloc(size, CheckMem);
+    if (result == NULL)
+    {
+        fprintf(listing, "Out of memory error at line %d\n", lineno);
+        exit(1);
+    }
+    /* the annotations, the dependencies, the lines and
+     * the text follow the header in the same block
+     */
+    result->refcount = 1;
+    result->annotations = (Annotation*)(result + 1);
+    result->annotationCount = nodes;
+    result->deps = (Dependency*)(result->annotations + nodes);
+    result->lines = (DiagLine*)(result->deps + set->count);
+    result->lineCount = diagnostics->lineCount;
+    text = (char*)(result->lines + result->lineCount);
+    for (i = 0; i <= set->mask; ++i)
+    {
+        if (set->slots[i].name)
+        {
+            result->deps[n].name = strcpy(text, set->slots[i].name);
+            result->deps[n++].signature = set->slots[i].signature;
+            text += strlen(text) + 1;
+        }
+    }
+    result->depCount = n;
+    result->diagnostics = text;
+    result->diagnosticsSize = textSize;
+    for (i = 0; i < result->lineCount; ++i)
+    {
+        DiagLine* line = &diagnostics->lines[i];
+        memcpy(text, diagnostics->text + from, line->offset - from);
+        text += line->offset - from;
+        from = line->offset + digits(line->lineno);
+        result->lines[i].offset = (int)(text - result->diagnostics);
+        result->lines[i].lineno = line->lineno - t->lineno;
+    }
+    if (diagnostics->size > from)
+        memcpy(text, diagnostics->text + from, diagnostics->size - from);
+    text[diagnostics->size - from] = '\0';
+    next = result->annotations;
+    recordAnnotations(t, &next);
+    st_set_check(current_symtab, slot, result);
+    st_release_check(result);
+    endDependencies(set);
+}
+
+/* Function reuseCheck returns TRUE if all of the
+ * dependencies of result still resolve to the same
+ * signatures, and then reports its diagnostics at
+ * the lines of function t and annotates t as the
+ * check did
+ */
+static int reuseCheck(TreeNode* t, CheckResult result)
+{
+    Annotation* next = result->annotations;
+    int i, from = 0;
+    for (i = 0; i < result->depCount; ++i)
+    {
+        BucketList symbol = st_resolve(current_symtab, current_symtab->global, result->deps[i].name);
+        if (signatureHash(symbol) != result->deps[i].signature)
+            return FALSE;
+    }
+    for (i = 0; i < result->lineCount; ++i)
+    {
+        reportText(result->diagnostics + from, result->lines[i].offset - from);
+        reportLine(t->lineno + result->lines[i].lineno);
+        from = result->lines[i].offset;
+    }
+    reportText(result->diagnostics + from, result->diagnosticsSize - from);
+    annotate(t, &next);
+    return TRUE;
+}
+
+/* Function lookupName resolves name from scope and
+ * records the dependency
+ */
+static BucketList lookupName(ScopeList scope, char* name)
+{
+    BucketList symbol = st_resolve(current_symtab, scope, name);
+    recordDependency(name, symbol);
+    return symbol;
+}
+
+/* Function resolveNode returns the declaration the
+ * name of t refers to, looking it up only if the
+ * symbol table build left it unresolved
+ */
+static BucketList resolveNode(TreeNode* t, ScopeList scope)
+{
+    if (t->symbol == NULL)
+    {
+        t->symbol = st_resolve(current_symtab, scope, t->attr.name);
+    }
+    recordDependency(t->attr.name, t->symbol);
+    return t->symbol;
+}
+
 static void checkNode(TreeNode* t)
 {
     ScopeStackPair* pair = scope_stack_top();
@@ -409,8 +1088,7 @@ static void checkNode(TreeNode* t)
                 }
                 case CallK:
                 {
-                    BucketList bucket =
-                        st_lookup(pair->scope, t->attr.name);
+                    BucketList bucket = resolveNode(t, pair->scope);
                     if (!bucket)
                     {
                         t->type = Invalid;
@@ -457,7 +1135,7 @@ static void checkNode(TreeNode* t)
                     break;
                 case VarK:
                 {
-                    BucketList bucket = st_lookup(pair->scope, t->attr.name);
+                    BucketList bucket = resolveNode(t, pair->scope);
                     if (!bucket)
                     {
                         t->type = Invalid;
@@ -519,6 +1197,11 @@ static void checkNode(TreeNode* t)
                     break;
                 case ReturnK:
                 {
+                    /* every local is declared by now, so this
+                     * finds what the function name means here
+                     */
+                    BucketList current_function = lookupName(
+                        current_declaration->scope, current_declaration->attr.name);
                     if (current_function->type == Void && t->child[0])
                     {
                         typeError(t->child[0], "Function of type 'void' cannot return a value.");
@@ -568,10 +1251,366 @@ static void checkNode(TreeNode* t)
     }
 }
 
+/* Procedure flushDiagnostics writes count buffers,
+ * every stride-th one from first, to the listing
+ */
+static void flushDiagnostics(DiagBuffer* first, int count, int stride)
+{
+    int i;
+    for (i = 0; i < count; ++i)
+    {
+        DiagBuffer* buffer = &first[stride * i];
+        if (buffer->size > 0)
+        {
+            fwrite(buffer->text, 1, buffer->size, listing);
+            Error = TRUE;
+        }
+        free(buffer->text);
+        free(buffer->lines);
+    }
+}
+
+/* checkThreads is the number of threads typeCheck
+ * may use
+ */
+static int checkThreads = 1;
+
+/* MINWORK is the least number of declarations worth
+ * a thread of their own
+ */
+#define MINWORK 16
+
+void setCheckThreads(int threads)
+{
+    checkThreads = threads > 0 ? threads : 1;
+}
+
+/* slots[i] is the number of the function table of
+ * the i-th declaration, or -1
+ */
+typedef struct
+{
+    Symtab tab;
+    TreeNode** declarations;
+    int* slots;
+    DiagBuffer* buffers;
+} CheckJob;
+
+/* Procedure checkFunction type checks function t,
+ * the slot-th function of the version, or reuses the
+ * result of its last check if nothing it depends on
+ * has changed
+ */
+static void checkFunction(TreeNode* t, int slot)
+{
+    DepSet set;
+    CheckResult result = current_symtab->checks[slot];
+    if (result != NULL && reuseCheck(t, result))
+        return;
+    beginDependencies(&set);
+    traverseNode(t, beforeCheckNode, checkNode);
+    saveCheck(t, slot, &set);
+}
+
+/* Procedure checkDeclaration type checks the
+ * index-th declaration of a CheckJob into its buffer
+ */
+static void checkDeclaration(void* arg, int index)
+{
+    CheckJob* job = (CheckJob*)arg;
+    TreeNode* t = job->declarations[index];
+    current_symtab = job->tab;
+    diagnostics = &job->buffers[index];
+    scope_stack_top_index = -1;
+    scope_stack_push(job->tab->global, 0);
+    ev_begin("check", t->nodekind == DeclarationK ? t->attr.name : "");
+    if (job->slots[index] >= 0)
+        checkFunction(t, job->slots[index]);
+    else
+        traverseNode(t, beforeCheckNode, checkNode);
+    ev_end();
+    diagnostics = NULL;
+}
+
 /* Procedure typeCheck performs type checking
- * by a postorder syntax tree traversal
+ * by a postorder syntax tree traversal.
+ * With the global scope filled, declarations are
+ * independent, so large programs are checked by
+ * several threads and the diagnostics of each
+ * declaration are written in source order afterwards.
+ * Functions whose scope table is shared with an
+ * earlier version are only checked again if a global
+ * they use changed
+ */
+void typeCheck(TreeNode* syntaxTree, Symtab tab)
+{
+    CheckJob job;
+    TreeNode* t;
+    int count = 0, units = 0, threads, i;
+    for (t = syntaxTree; t != NULL; t = t->sibling)
+        ++count;
+    threads = count / MINWORK < checkThreads ? count / MINWORK : checkThreads;
+    job.tab = tab;
+    job.declarations = (TreeNode**)malloc((count + 1) * sizeof(TreeNode*));
+    job.slots = (int*)malloc((count + 1) * sizeof(int));
+    job.buffers = (DiagBuffer*)calloc(count + 1, sizeof(DiagBuffer));
+    if (job.declarations == NULL || job.slots == NULL || job.buffers == NULL)
+    {
+        fprintf(listing, "Out of memory error at line %d\n", lineno);
+        exit(1);
+    }
+    /* buildSymtab gave every function, in order, a
+     * table of the version
+     */
+    for (t = syntaxTree, i = 0; t != NULL; t = t->sibling, ++i)
+    {
+        job.declarations[i] = t;
+        job.slots[i] = -1;
+        if (t->nodekind == DeclarationK && t->kind.declaration == FuncK && t->scope)
+        {
+            if (units < tab->unitCount && tab->units[units] == t->scope->table)
+                job.slots[i] = units;
+            ++units;
+        }
+    }
+    parallel_for(count, threads, checkDeclaration, &job);
+    flushDiagnostics(job.buffers, count, 1);
+    free(job.buffers);
+    free(job.slots);
+    free(job.declarations);
+}
+
+/* declaration_diagnostics points at the buffers of
+ * the declaration being analyzed by analyze: symbol
+ * table errors first, type errors second
+ */
+static DiagBuffer* declaration_diagnostics;
+
+static void insertBeforeCheck(TreeNode* t)
+{
+    diagnostics = &declaration_diagnostics[0];
+    insertNode(t);
+}
+
+static void checkAfterInsert(TreeNode* t)
+{
+    diagnostics = &declaration_diagnostics[1];
+    checkNode(t);
+}
+
+/* Function analyze builds the symbol table and type
+ * checks in a single traversal of each function.
+ * Globals and function signatures are entered first,
+ * so names resolve as they do in typeCheck, and the
+ * diagnostics are buffered per declaration so that
+ * they come out in the order of buildSymtab followed
+ * by typeCheck
+ */
+Symtab analyze(TreeNode* syntaxTree, Symtab previous)
+{
+    UnitIndex index;
+    DiagBuffer* buffers;
+    TreeNode* t;
+    int count = 0, i;
+    if (TraceAnalyze)
+    {
+        st_set_xref(TRUE);
+    }
+    for (t = syntaxTree; t != NULL; t = t->sibling)
+        ++count;
+    buffers = (DiagBuffer*)calloc(2 * count + 1, sizeof(DiagBuffer));
+    if (buffers == NULL)
+    {
+        fprintf(listing, "Out of memory error at line %d\n", lineno);
+        exit(1);
+    }
+    current_symtab = st_create();
+    init_global_scope(current_symtab);
+    indexUnits(&index, previous);
+    for (t = syntaxTree, i = 0; t != NULL; t = t->sibling, ++i)
+    {
+        diagnostics = &buffers[2 * i];
+        if (t->nodekind == DeclarationK && t->kind.declaration == FuncK)
+            declareFunction(t, scope_stack_top());
+        else
+            traverseNode(t, insertNode, afterInsertNode);
+    }
+    signatures_declared = TRUE;
+    for (t = syntaxTree, i = 0; t != NULL; t = t->sibling, ++i)
+    {
+        declaration_diagnostics = &buffers[2 * i];
+        diagnostics = &buffers[2 * i + 1];
+        if (t->nodekind == DeclarationK && t->kind.declaration == FuncK)
+        {
+            DepSet set;
+            beginDependencies(&set);
+            if (insertFunction(t, &index, insertBeforeCheck, checkAfterInsert))
+            {
+                endDependencies(&set);
+                diagnostics = &buffers[2 * i + 1];
+                checkFunction(t, current_symtab->unitCount - 1);
+            }
+            else
+            {
+                diagnostics = &buffers[2 * i + 1];
+                saveCheck(t, current_symtab->unitCount - 1, &set);
+            }
+        }
+        else
+        {
+            traverseNode(t, beforeCheckNode, checkNode);
+        }
+    }
+    signatures_declared = FALSE;
+    diagnostics = NULL;
+    free(index.slots);
+    flushDiagnostics(buffers, count, 2);
+    if (TraceAnalyze)
+    {
+        printSymTab(listing, current_symtab);
+        printFuncTab(listing, current_symtab);
+    }
+    flushDiagnostics(buffers + 1, count, 2);
+    free(buffers);
+    return current_symtab;
+}
+
+/* Function analyzeBegin creates the version that
+ * analyzeDeclaration enters declarations into
+ */
+Symtab analyzeBegin(void)
+{
+    if (TraceAnalyze)
+    {
+        st_set_xref(TRUE);
+    }
+    current_symtab = st_create();
+    init_global_scope(current_symtab);
+    return current_symtab;
+}
+
+/* StreamCheck is a declaration whose type errors
+ * streaming mode holds until the end of the input,
+ * to write them after every symbol table error as
+ * typeCheck does. held is the declaration itself if
+ * it uses a name declared further down, and is
+ * checked only when every global is known
  */
-void typeCheck(TreeNode* syntaxTree)
+typedef struct
+{
+    TreeNode* held;
+    DiagBuffer buffer;
+} StreamCheck;
+
+static StreamCheck* streamChecks = NULL;
+static int streamCheckCount = 0;
+static int streamCheckCapacity = 0;
+
+/* Function usesUnresolved returns TRUE if a name in
+ * t, its children or its siblings was not declared
+ * when the symbol table was built
+ */
+static int usesUnresolved(TreeNode* t)
+{
+    int i;
+    for (; t != NULL; t = t->sibling)
+    {
+        if (t->nodekind == ExpK && (t->kind.exp == CallK || t->kind.exp == VarK) && t->symbol == NULL)
+            return TRUE;
+        for (i = 0; i < MAXCHILDREN; i++)
+            if (usesUnresolved(t->child[i]))
+                return TRUE;
+    }
+    return FALSE;
+}
+
+/* Procedure holdCheck keeps the type errors in
+ * buffer, and held if it is not NULL, for analyzeEnd
+ */
+static void holdCheck(TreeNode* held, DiagBuffer* buffer)
+{
+    if (held == NULL && buffer->size == 0)
+    {
+        free(buffer->text);
+        free(buffer->lines);
+        return;
+    }
+    if (streamCheckCount == streamCheckCapacity)
+    {
+        streamCheckCapacity = streamCheckCapacity ? 2 * streamCheckCapacity : 16;
+        streamChecks = (StreamCheck*)realloc(streamChecks, streamCheckCapacity * sizeof(StreamCheck));
+        if (streamChecks == NULL)
+        {
+            fprintf(listing, "Out of memory error at line %d\n", lineno);
+            exit(1);
+        }
+    }
+    streamChecks[streamCheckCount].held = held;
+    streamChecks[streamCheckCount].buffer = *buffer;
+    ++streamCheckCount;
+}
+
+int analyzeDeclaration(Symtab tab, TreeNode* t)
 {
-    traverse(syntaxTree, beforeCheckNode, checkNode);
+    DiagBuffer buffers[2];
+    TreeNode* held = NULL;
+    memset(buffers, 0, sizeof(buffers));
+    current_symtab = tab;
+    diagnostics = &buffers[0];
+    ev_begin("function", t->nodekind == DeclarationK ? t->attr.name : "");
+    if (t->nodekind == DeclarationK && t->kind.declaration == FuncK)
+    {
+        declareFunction(t, scope_stack_top());
+        signatures_declared = TRUE;
+        traverseNode(t, insertNode, afterInsertNode);
+        signatures_declared = FALSE;
+        if (usesUnresolved(t->child[1]))
+            held = t;
+    }
+    else
+    {
+        traverseNode(t, insertNode, afterInsertNode);
+    }
+    if (held == NULL)
+    {
+        diagnostics = &buffers[1];
+        traverseNode(t, beforeCheckNode, checkNode);
+    }
+    ev_end();
+    diagnostics = NULL;
+    flushDiagnostics(buffers, 1, 1);
+    holdCheck(held, &buffers[1]);
+    return held == NULL;
+}
+
+void analyzeEnd(Symtab tab)
+{
+    int i;
+    current_symtab = tab;
+    for (i = 0; i < streamCheckCount; ++i)
+    {
+        StreamCheck* check = &streamChecks[i];
+        if (check->held != NULL)
+        {
+            diagnostics = &check->buffer;
+            ev_begin("check", check->held->attr.name);
+            traverseNode(check->held, beforeCheckNode, checkNode);
+            ev_end();
+            diagnostics = NULL;
+            releaseDeclaration(check->held);
+        }
+        flushDiagnostics(&check->buffer, 1, 1);
+    }
+    free(streamChecks);
+    streamChecks = NULL;
+    streamCheckCount = streamCheckCapacity = 0;
+}
+
+void releaseDeclaration(TreeNode* t)
+{
+    if (t->nodekind == DeclarationK && t->kind.declaration == FuncK)
+    {
+        st_destroy(t->scope);
+    }
+    freeTree(t);
 }
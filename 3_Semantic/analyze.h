@@ -8,14 +8,60 @@
 #ifndef _ANALYZE_H_
 #define _ANALYZE_H_
 
+#include "symtab.h"
+
 /* Function buildSymtab constructs the symbol
- * table by preorder traversal of the syntax tree
+ * table by preorder traversal of the syntax tree.
+ * Functions that are unchanged since previous (a
+ * version built from an earlier tree, or NULL) share
+ * its scope tables. The result is released with
+ * st_release
  */
-void buildSymtab(TreeNode*);
+Symtab buildSymtab(TreeNode* syntaxTree, Symtab previous);
 
 /* Procedure typeCheck performs type checking
- * by a postorder syntax tree traversal
+ * by a postorder syntax tree traversal. Function
+ * bodies may be checked in parallel; diagnostics
+ * still come out in source order
+ */
+void typeCheck(TreeNode* syntaxTree, Symtab tab);
+
+/* Procedure setCheckThreads sets the number of
+ * threads typeCheck may use (1 by default)
+ */
+void setCheckThreads(int threads);
+
+/* Function analyze does the work of buildSymtab and
+ * typeCheck in a single traversal of each function,
+ * with the same diagnostics in the same order
+ */
+Symtab analyze(TreeNode* syntaxTree, Symtab previous);
+
+/* Function analyzeBegin starts a streaming analysis
+ * and returns the version that keeps its globals
+ */
+Symtab analyzeBegin(void);
+
+/* Function analyzeDeclaration enters and checks the
+ * top-level declaration t against the globals
+ * declared before it and writes its symbol table
+ * errors; its type errors are held for analyzeEnd.
+ * A function that uses a name not declared yet is
+ * checked by analyzeEnd instead. It returns FALSE
+ * then, and analyzeEnd frees t
+ */
+int analyzeDeclaration(Symtab tab, TreeNode* t);
+
+/* Procedure analyzeEnd checks the declarations that
+ * were held, now that every global is declared, and
+ * writes the type errors of all declarations in
+ * source order
+ */
+void analyzeEnd(Symtab tab);
+
+/* Procedure releaseDeclaration frees declaration t
+ * and the scopes of a function once it is done with
  */
-void typeCheck(TreeNode*);
+void releaseDeclaration(TreeNode* t);
 
 #endif
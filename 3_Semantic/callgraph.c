@@ -0,0 +1,419 @@
+/****************************************************/
+/* File: callgraph.c                                */
+/* Call graph implementation                        */
+/* for the C-Minus compiler                         */
+/* Functions are nodes, CallK nodes give the edges; */
+/* recursion is found with Tarjan's algorithm       */
+/****************************************************/
+
+#include "globals.h"
+#include "util.h"
+#include "memtrack.h"
+#include "callgraph.h"
+
+typedef struct
+{
+    char* name;
+    TreeNode* decl; /* NULL once pruned */
+    int builtin;
+    int* callees;
+    int calleeCount;
+    int calleeCapacity;
+    int reachable;
+    int scc;       /* component, callees before callers */
+    int recursive; /* on a cycle of the graph */
+} CallNode;
+
+struct CallGraphRec
+{
+    CallNode* nodes;
+    int count;
+    int* slots; /* node number + 1 by name, 0 if empty */
+    int mask;
+    int sccCount;
+    int hasMain;
+};
+
+static void* allocOrDie(size_t size)
+{
+    void* p = calloc(1, size);
+    if (p == NULL)
+    {
+        fprintf(listing, "Out of memory error at line %d\n", lineno);
+        exit(1);
+    }
+    return p;
+}
+
+static unsigned long hashName(const char* s)
+{
+    unsigned long h = 14695981039346656037UL;
+    while (*s)
+        h = (h ^ (unsigned char)*s++) * 1099511628211UL;
+    return h;
+}
+
+/* Function findNode returns the number of the node
+ * called name, or -1
+ */
+static int findNode(CallGraph g, const char* name)
+{
+    int j = (int)(hashName(name) & g->mask);
+    while (g->slots[j])
+    {
+        if (strcmp(g->nodes[g->slots[j] - 1].name, name) == 0)
+            return g->slots[j] - 1;
+        j = (j + 1) & g->mask;
+    }
+    return -1;
+}
+
+static void addNode(CallGraph g, char* name, TreeNode* decl)
+{
+    int j = (int)(hashName(name) & g->mask);
+    while (g->slots[j])
+    {
+        if (strcmp(g->nodes[g->slots[j] - 1].name, name) == 0)
+            return; /* redeclared: the first declaration counts */
+        j = (j + 1) & g->mask;
+    }
+    g->nodes[g->count].name = copyString(name);
+    g->nodes[g->count].decl = decl;
+    g->nodes[g->count].builtin = decl == NULL;
+    g->slots[j] = ++g->count;
+}
+
+static void addEdge(CallNode* caller, int callee)
+{
+    if (caller->calleeCount == caller->calleeCapacity)
+    {
+        caller->calleeCapacity = caller->calleeCapacity ? caller->calleeCapacity * 2 : 4;
+        caller->callees = (int*)realloc(caller->callees, caller->calleeCapacity * sizeof(int));
+        if (caller->callees == NULL)
+        {
+            fprintf(listing, "Out of memory error at line %d\n", lineno);
+            exit(1);
+        }
+    }
+    caller->callees[caller->calleeCount++] = callee;
+}
+
+/* Procedure collectCalls adds an edge from caller to
+ * every function called in t. mark[v] is caller + 1
+ * once the edge to v is in, so each edge is added once
+ */
+static void collectCalls(CallGraph g, int caller, TreeNode* t, int* mark)
+{
+    int i;
+    for (; t != NULL; t = t->sibling)
+    {
+        if (t->nodekind == ExpK && t->kind.exp == CallK &&
+            (t->symbol == NULL || t->symbol->kind == FuncSymbol))
+        {
+            int callee = findNode(g, t->attr.name);
+            if (callee >= 0 && mark[callee] != caller + 1)
+            {
+                mark[callee] = caller + 1;
+                addEdge(&g->nodes[caller], callee);
+            }
+        }
+        for (i = 0; i < MAXCHILDREN; i++)
+            collectCalls(g, caller, t->child[i], mark);
+    }
+}
+
+static void markReachable(CallGraph g, int root, int* stack)
+{
+    int top = 0, i;
+    if (g->nodes[root].reachable)
+        return;
+    g->nodes[root].reachable = TRUE;
+    stack[top++] = root;
+    while (top > 0)
+    {
+        CallNode* v = &g->nodes[stack[--top]];
+        for (i = 0; i < v->calleeCount; ++i)
+        {
+            CallNode* w = &g->nodes[v->callees[i]];
+            if (!w->reachable)
+            {
+                w->reachable = TRUE;
+                stack[top++] = v->callees[i];
+            }
+        }
+    }
+}
+
+/* Procedure findComponents numbers the strongly
+ * connected components with Tarjan's algorithm,
+ * run with an explicit stack so that deep call
+ * chains do not exhaust the C stack
+ */
+static void findComponents(CallGraph g)
+{
+    int n = g->count, counter = 0, top = 0, frames = 0, v;
+    int* index = (int*)allocOrDie((n + 1) * sizeof(int));
+    int* low = (int*)allocOrDie((n + 1) * sizeof(int));
+    int* onStack = (int*)allocOrDie((n + 1) * sizeof(int));
+    int* stack = (int*)allocOrDie((n + 1) * sizeof(int));
+    int* frameNode = (int*)allocOrDie((n + 1) * sizeof(int));
+    int* frameEdge = (int*)allocOrDie((n + 1) * sizeof(int));
+    for (v = 0; v < n; ++v)
+        index[v] = -1;
+    for (v = 0; v < n; ++v)
+    {
+        if (index[v] >= 0)
+            continue;
+        index[v] = low[v] = counter++;
+        stack[top++] = v;
+        onStack[v] = TRUE;
+        frameNode[frames] = v;
+        frameEdge[frames++] = 0;
+        while (frames > 0)
+        {
+            int u = frameNode[frames - 1];
+            CallNode* node = &g->nodes[u];
+            if (frameEdge[frames - 1] < node->calleeCount)
+            {
+                int w = node->callees[frameEdge[frames - 1]++];
+                if (w == u)
+                    node->recursive = TRUE;
+                if (index[w] < 0)
+                {
+                    index[w] = low[w] = counter++;
+                    stack[top++] = w;
+                    onStack[w] = TRUE;
+                    frameNode[frames] = w;
+                    frameEdge[frames++] = 0;
+                }
+                else if (onStack[w] && index[w] < low[u])
+                    low[u] = index[w];
+                continue;
+            }
+            if (low[u] == index[u])
+            {
+                int w, size = 0;
+                do
+                {
+                    w = stack[--top];
+                    onStack[w] = FALSE;
+                    g->nodes[w].scc = g->sccCount;
+                    ++size;
+                } while (w != u);
+                if (size > 1)
+                {
+                    int i;
+                    for (i = top; i < top + size; ++i)
+                        g->nodes[stack[i]].recursive = TRUE;
+                }
+                ++g->sccCount;
+            }
+            if (--frames > 0 && low[u] < low[frameNode[frames - 1]])
+                low[frameNode[frames - 1]] = low[u];
+        }
+    }
+    free(index);
+    free(low);
+    free(onStack);
+    free(stack);
+    free(frameNode);
+    free(frameEdge);
+}
+
+CallGraph cg_build(TreeNode* syntaxTree, Symtab tab)
+{
+    CallGraph g = (CallGraph)allocOrDie(sizeof(struct CallGraphRec));
+    TreeNode* t;
+    int count = 0, size = 16, i, v;
+    int* work;
+    BucketList l;
+    for (t = syntaxTree; t != NULL; t = t->sibling)
+        ++count;
+    for (i = 0; i < SIZE; ++i)
+    {
+        for (l = tab->global->bucket[i]; l != NULL; l = l->next)
+            ++count;
+    }
+    while (size < count * 2)
+        size *= 2;
+    g->nodes = (CallNode*)allocOrDie((count + 1) * sizeof(CallNode));
+    g->slots = (int*)allocOrDie(size * sizeof(int));
+    g->mask = size - 1;
+    for (t = syntaxTree; t != NULL; t = t->sibling)
+    {
+        if (t->nodekind == DeclarationK && t->kind.declaration == FuncK)
+            addNode(g, t->attr.name, t);
+    }
+    /* global functions that are not declared in the
+     * program are the built-ins
+     */
+    for (i = 0; i < SIZE; ++i)
+    {
+        for (l = tab->global->bucket[i]; l != NULL; l = l->next)
+        {
+            if (l->kind == FuncSymbol && findNode(g, l->name) < 0)
+                addNode(g, l->name, NULL);
+        }
+    }
+    work = (int*)allocOrDie((g->count + 1) * sizeof(int));
+    for (v = 0; v < g->count; ++v)
+    {
+        if (g->nodes[v].decl)
+            collectCalls(g, v, g->nodes[v].decl->child[1], work);
+    }
+    v = findNode(g, "main");
+    g->hasMain = v >= 0 && !g->nodes[v].builtin;
+    if (g->hasMain)
+        markReachable(g, v, work);
+    for (v = 0; v < g->count; ++v)
+    {
+        if (g->nodes[v].builtin)
+            markReachable(g, v, work);
+    }
+    free(work);
+    findComponents(g);
+    return g;
+}
+
+TreeNode* cg_prune(TreeNode* syntaxTree, CallGraph g)
+{
+    TreeNode** link = &syntaxTree;
+    if (!g->hasMain)
+        return syntaxTree;
+    while (*link != NULL)
+    {
+        TreeNode* t = *link;
+        if (t->nodekind == DeclarationK && t->kind.declaration == FuncK)
+        {
+            int v = findNode(g, t->attr.name);
+            if (v >= 0 && !g->nodes[v].reachable)
+            {
+                *link = t->sibling;
+                t->sibling = NULL;
+                if (g->nodes[v].decl == t)
+                    g->nodes[v].decl = NULL;
+                freeTree(t);
+                continue;
+            }
+        }
+        link = &t->sibling;
+    }
+    return syntaxTree;
+}
+
+/* Function componentOrder returns the node numbers
+ * sorted by component, by a counting sort
+ */
+static int* componentOrder(CallGraph g)
+{
+    int* start = (int*)allocOrDie((g->sccCount + 1) * sizeof(int));
+    int* order = (int*)allocOrDie((g->count + 1) * sizeof(int));
+    int v, c, sum = 0;
+    for (v = 0; v < g->count; ++v)
+        ++start[g->nodes[v].scc];
+    for (c = 0; c < g->sccCount; ++c)
+    {
+        int n = start[c];
+        start[c] = sum;
+        sum += n;
+    }
+    for (v = 0; v < g->count; ++v)
+        order[start[g->nodes[v].scc]++] = v;
+    free(start);
+    return order;
+}
+
+static void printText(FILE* out, CallGraph g)
+{
+    int* order;
+    int v, i;
+    fprintf(out, "\n< Call Graph >\n");
+    fprintf(out, "Function Name  Reachable  Recursive  Calls\n");
+    fprintf(out, "-------------  ---------  ---------  -----\n");
+    for (v = 0; v < g->count; ++v)
+    {
+        CallNode* node = &g->nodes[v];
+        fprintf(out, "%-14s %-10s %-10s",
+                node->name,
+                node->reachable ? "yes" : "no",
+                node->builtin ? "built-in" : node->recursive ? "yes" : "no");
+        for (i = 0; i < node->calleeCount; ++i)
+            fprintf(out, " %s", g->nodes[node->callees[i]].name);
+        fprintf(out, "\n");
+    }
+    fprintf(out, "\nRecursive components (callees first):\n");
+    order = componentOrder(g);
+    for (i = 0; i < g->count; ++i)
+    {
+        CallNode* node = &g->nodes[order[i]];
+        int first = i == 0 || g->nodes[order[i - 1]].scc != node->scc;
+        int last = i == g->count - 1 || g->nodes[order[i + 1]].scc != node->scc;
+        if (!node->recursive)
+            continue;
+        fprintf(out, first ? "  { %s" : ", %s", node->name);
+        if (last)
+            fprintf(out, " }\n");
+    }
+    free(order);
+}
+
+static void printDot(FILE* out, CallGraph g)
+{
+    int* order;
+    int v, i;
+    fprintf(out, "digraph callgraph {\n");
+    for (v = 0; v < g->count; ++v)
+    {
+        CallNode* node = &g->nodes[v];
+        fprintf(out, "    \"%s\"", node->name);
+        if (node->builtin)
+            fprintf(out, " [shape=box]");
+        else if (!node->reachable)
+            fprintf(out, " [style=dashed]");
+        fprintf(out, ";\n");
+    }
+    for (v = 0; v < g->count; ++v)
+    {
+        for (i = 0; i < g->nodes[v].calleeCount; ++i)
+            fprintf(out, "    \"%s\" -> \"%s\";\n", g->nodes[v].name, g->nodes[g->nodes[v].callees[i]].name);
+    }
+    order = componentOrder(g);
+    for (i = 0; i < g->count; ++i)
+    {
+        CallNode* node = &g->nodes[order[i]];
+        int first = i == 0 || g->nodes[order[i - 1]].scc != node->scc;
+        int last = i == g->count - 1 || g->nodes[order[i + 1]].scc != node->scc;
+        if (!node->recursive)
+            continue;
+        if (first)
+            fprintf(out, "    subgraph cluster_%d {\n        label=\"recursive\";\n", node->scc);
+        fprintf(out, "        \"%s\";\n", node->name);
+        if (last)
+            fprintf(out, "    }\n");
+    }
+    free(order);
+    fprintf(out, "}\n");
+}
+
+void cg_print(FILE* out, CallGraph g, int dot)
+{
+    if (dot)
+        printDot(out, g);
+    else
+        printText(out, g);
+}
+
+void cg_free(CallGraph g)
+{
+    int v;
+    if (g == NULL)
+        return;
+    for (v = 0; v < g->count; ++v)
+    {
+        mt_free(g->nodes[v].name, NameMem);
+        free(g->nodes[v].callees);
+    }
+    free(g->nodes);
+    free(g->slots);
+    free(g);
+}
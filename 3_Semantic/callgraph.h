@@ -0,0 +1,39 @@
+/****************************************************/
+/* File: callgraph.h                                */
+/* Call graph interface for the C-Minus compiler    */
+/* (reachability from main, recursion by strongly   */
+/* connected components)                            */
+/****************************************************/
+
+#ifndef _CALLGRAPH_H_
+#define _CALLGRAPH_H_
+
+#include "globals.h"
+#include "symtab.h"
+
+typedef struct CallGraphRec* CallGraph;
+
+/* Function cg_build builds the call graph of the
+ * checked syntax tree from its CallK nodes. Its roots
+ * are main and the built-in functions of tab
+ */
+CallGraph cg_build(TreeNode* syntaxTree, Symtab tab);
+
+/* Function cg_prune unlinks and frees the function
+ * declarations that are unreachable from the roots
+ * and returns the new head of the declaration list.
+ * A program without main is left as it is
+ */
+TreeNode* cg_prune(TreeNode* syntaxTree, CallGraph g);
+
+/* Procedure cg_print writes the call graph, the
+ * unreachable functions and the recursive strongly
+ * connected components to out, as text or, if dot is
+ * TRUE, in the DOT language of Graphviz
+ */
+void cg_print(FILE* out, CallGraph g, int dot);
+
+/* Procedure cg_free frees the call graph */
+void cg_free(CallGraph g);
+
+#endif
@@ -1,231 +1,544 @@
 /****************************************************/
 /* File: cgen.c                                     */
 /* The code generator implementation                */
-/* for the TINY compiler                            */
+/* for the C-Minus compiler                         */
 /* (generates code for the TM machine)              */
 /* Compiler Construction: Principles and Practice   */
 /* Kenneth C. Louden                                */
 /****************************************************/
 
 #include "globals.h"
-#include "symtab.h"
 #include "code.h"
+#include "tmb.h"
+#include "ir.h"
+#include "regalloc.h"
 #include "cgen.h"
 
-/* tmpOffset is the memory offset for temps
-   It is decremented each time a temp is
-   stored, and incremeted when loaded again
-*/
-static int tmpOffset = 0;
-
-/* prototype for internal recursive code generator */
-static void cGen(TreeNode* tree);
-
-/* Procedure genStmt generates code at a statement node */
-static void genStmt(TreeNode* tree)
-{
-    TreeNode *p1, *p2, *p3;
-    int savedLoc1, savedLoc2, currentLoc;
-    int loc;
-    switch (tree->kind.stmt)
-    {
-        case IfK:
-            if (TraceCode)
-                emitComment("-> if");
-            p1 = tree->child[0];
-            p2 = tree->child[1];
-            p3 = tree->child[2];
-            /* generate code for test expression */
-            cGen(p1);
-            savedLoc1 = emitSkip(1);
-            emitComment("if: jump to else belongs here");
-            /* recurse on then part */
-            cGen(p2);
-            savedLoc2 = emitSkip(1);
-            emitComment("if: jump to end belongs here");
-            currentLoc = emitSkip(0);
-            emitBackup(savedLoc1);
-            emitRM_Abs("JEQ", ac, currentLoc, "if: jmp to else");
-            emitRestore();
-            /* recurse on else part */
-            cGen(p3);
-            currentLoc = emitSkip(0);
-            emitBackup(savedLoc2);
-            emitRM_Abs("LDA", pc, currentLoc, "jmp to end");
-            emitRestore();
-            if (TraceCode)
-                emitComment("<- if");
-            break; /* if_k */
-
-        case RepeatK:
-            if (TraceCode)
-                emitComment("-> repeat");
-            p1 = tree->child[0];
-            p2 = tree->child[1];
-            savedLoc1 = emitSkip(0);
-            emitComment("repeat: jump after body comes back here");
-            /* generate code for body */
-            cGen(p1);
-            /* generate code for test */
-            cGen(p2);
-            emitRM_Abs("JEQ", ac, savedLoc1, "repeat: jmp back to body");
-            if (TraceCode)
-                emitComment("<- repeat");
-            break; /* repeat */
-
-        case AssignK:
-            if (TraceCode)
-                emitComment("-> assign");
-            /* generate code for rhs */
-            cGen(tree->child[0]);
-            /* now store value */
-            loc = st_lookup(tree->attr.name);
-            emitRM("ST", ac, loc, gp, "assign: store value");
-            if (TraceCode)
-                emitComment("<- assign");
-            break; /* assign_k */
-
-        case ReadK:
-            emitRO("IN", ac, 0, 0, "read integer value");
-            loc = st_lookup(tree->attr.name);
-            emitRM("ST", ac, loc, gp, "read: store value");
+/* Activation record of a function, at fp:
+ *
+ *   0(fp)           control link (caller's fp)
+ *  -1(fp)           return address
+ *  -2-i(fp)         parameter i; array parameters
+ *                   hold the address of the array
+ *   below           local arrays, saved registers,
+ *                   then temps kept in memory
+ *
+ * A call builds the callee's record right below
+ * the slots of the caller, so no stack pointer is
+ * kept. The result is returned in ac. Temps live
+ * in registers FIRSTTEMP..LASTTEMP or in the frame;
+ * ac and ac1 hold the operands of one instruction.
+ * A caller saves the registers live across a call
+ */
+
+/* the function being generated */
+static IrFunction function;
+
+/* reg[t] is the location of temp t, as given by
+ * ra_allocate, and slot[t] its frame offset when
+ * it is kept in memory
+ */
+static int* reg;
+static int* slot;
+
+/* frameTop is the offset of the next free slot of
+ * the running function's record, where the records
+ * of the functions it calls start
+ */
+static int frameTop;
+
+/* globalSize is the number of locations taken by
+ * the globals, from 0 up
+ */
+static int globalSize;
+
+/* saveSlot[r] is where calls save register r */
+static int saveSlot[LASTTEMP + 1];
+
+/* blockLabel[i] is the label of block i, and next
+ * the block laid out after the one generated
+ */
+static int* blockLabel;
+static IrBlock next;
+
+/* Function fetch returns the register holding the
+ * operand o, loading it into scratch if it is not
+ * in one
+ */
+static int fetch(IrOperand o, int scratch)
+{
+    switch (o.kind)
+    {
+        case IrTemp:
+            if (reg[o.value] >= ac)
+                return reg[o.value];
+            emitRM("LD", scratch, slot[o.value], fp, "load temp");
+            return scratch;
+        case IrConst:
+            emitRM("LDC", scratch, o.value, 0, "load const");
+            return scratch;
+        case IrFrame:
+            return fp;
+        default:
+            emitComment("BUG: operand without a value");
+            return scratch;
+    }
+}
+
+/* Function target returns the register the result
+ * of an instruction is computed into
+ */
+static int target(IrOperand dst)
+{
+    return reg[dst.value] >= ac ? reg[dst.value] : ac;
+}
+
+/* Procedure keep stores the result in r of an
+ * instruction to its temp, if kept in memory
+ */
+static void keep(IrOperand dst, int r)
+{
+    if (reg[dst.value] == MEMORY)
+        emitRM("ST", r, slot[dst.value], fp, "store temp");
+}
+
+/* Function address returns the base register of
+ * the address base + offset of a load or a store,
+ * and sets *d to the offset from it
+ */
+static int address(IrOperand base, int offset, int scratch, int* d)
+{
+    if (base.kind == IrConst)
+    {
+        *d = base.value + offset;
+        return gp;
+    }
+    *d = offset;
+    return fetch(base, scratch);
+}
+
+/* Function jumpOf returns the jump taken when
+ * the relation holds of a difference and 0
+ */
+static char* jumpOf(IrOpcode relation)
+{
+    switch (relation)
+    {
+        case IrLt:
+            return "JLT";
+        case IrLe:
+            return "JLE";
+        case IrGt:
+            return "JGT";
+        case IrGe:
+            return "JGE";
+        case IrEq:
+            return "JEQ";
+        default:
+            return "JNE";
+    }
+}
+
+static IrOpcode inverse(IrOpcode relation)
+{
+    switch (relation)
+    {
+        case IrLt:
+            return IrGe;
+        case IrLe:
+            return IrGt;
+        case IrGt:
+            return IrLe;
+        case IrGe:
+            return IrLt;
+        case IrEq:
+            return IrNe;
+        default:
+            return IrEq;
+    }
+}
+
+/* Function swapped returns the relation of b and a
+ * that holds when the relation of a and b does
+ */
+static IrOpcode swapped(IrOpcode relation)
+{
+    switch (relation)
+    {
+        case IrLt:
+            return IrGt;
+        case IrLe:
+            return IrGe;
+        case IrGt:
+            return IrLt;
+        case IrGe:
+            return IrLe;
+        default:
+            return relation;
+    }
+}
+
+/* Function compare generates the comparison of a
+ * and b by *relation into r and returns the
+ * register whose value holds *relation with 0. A
+ * comparison with 0 needs no difference, and one
+ * with another constant subtracts it by an LDA
+ */
+static int compare(IrOperand a, IrOperand b, IrOpcode* relation, int r)
+{
+    int s;
+    if (a.kind == IrConst && b.kind != IrConst)
+    {
+        *relation = swapped(*relation);
+        return compare(b, a, relation, r);
+    }
+    if (b.kind == IrConst && b.value == 0)
+        return fetch(a, ac);
+    if (b.kind == IrConst)
+    {
+        s = fetch(a, ac);
+        emitRM("LDA", r, -b.value, s, "op: compare");
+        return r;
+    }
+    s = fetch(a, ac);
+    emitRO("SUB", r, s, fetch(b, ac1), "op: compare");
+    return r;
+}
+
+/* Procedure genMove generates dst = a */
+static void genMove(IrInstr in)
+{
+    int r, d = in->dst.value;
+    if (reg[d] == NOWHERE)
+        return;
+    if (reg[d] == MEMORY)
+    {
+        r = fetch(in->a, ac);
+        emitRM("ST", r, slot[d], fp, "move: store temp");
+        return;
+    }
+    r = reg[d];
+    if (in->a.kind == IrConst)
+        emitRM("LDC", r, in->a.value, 0, "move: load const");
+    else if (in->a.kind == IrTemp && reg[in->a.value] == MEMORY)
+        emitRM("LD", r, slot[in->a.value], fp, "move: load temp");
+    else if (in->a.kind != IrTemp || reg[in->a.value] != r)
+        emitRM("LDA", r, 0, fetch(in->a, ac), "move: copy register");
+}
+
+/* Procedure genArith generates an arithmetic
+ * instruction; a constant added or subtracted is
+ * the offset of an LDA
+ */
+static void genArith(IrInstr in)
+{
+    static char* ops[] = { "ADD", "SUB", "MUL", "DIV" };
+    int t = target(in->dst);
+    int s;
+    if (in->b.kind == IrConst && (in->op == IrAdd || in->op == IrSub))
+    {
+        s = fetch(in->a, ac);
+        emitRM("LDA", t, in->op == IrAdd ? in->b.value : -in->b.value, s, "op: add const");
+    }
+    else if (in->a.kind == IrConst && in->op == IrAdd)
+    {
+        s = fetch(in->b, ac);
+        emitRM("LDA", t, in->a.value, s, "op: add const");
+    }
+    else
+    {
+        s = fetch(in->a, ac);
+        emitRO(ops[in->op - IrAdd], t, s, fetch(in->b, ac1), "op");
+    }
+    keep(in->dst, t);
+}
+
+/* Procedure genRelation generates the value, 1 or
+ * 0, of a comparison
+ */
+static void genRelation(IrInstr in)
+{
+    IrOpcode relation = in->op;
+    int t = target(in->dst);
+    int trueLabel = emitNewLabel();
+    int endLabel = emitNewLabel();
+    int r = compare(in->a, in->b, &relation, t);
+    emitRM_Label(jumpOf(relation), r, trueLabel, "br if true");
+    emitRM("LDC", t, 0, 0, "false case");
+    emitRM_Label("LDA", pc, endLabel, "unconditional jmp");
+    emitLabel(trueLabel);
+    emitRM("LDC", t, 1, 0, "true case");
+    emitLabel(endLabel);
+    keep(in->dst, t);
+}
+
+/* Procedure genCall generates a call; the callee's
+ * record starts at frameTop
+ */
+static void genCall(IrInstr in)
+{
+    int returnLabel = emitNewLabel();
+    int i, r;
+    for (r = FIRSTTEMP; r <= LASTTEMP; ++r)
+        if (in->saves & (1 << r))
+            emitRM("ST", r, saveSlot[r], fp, "save register");
+    for (i = in->argCount - 1; i >= 0; --i)
+    {
+        r = fetch(in->args[i], ac);
+        emitRM("ST", r, frameTop - 2 - i, fp, "store argument");
+    }
+    emitRM("ST", fp, frameTop, fp, "store control link");
+    emitRM("LDA", fp, frameTop, fp, "push frame");
+    emitRM_Label("LDA", ac, returnLabel, "save return address");
+    emitRM_Label("LDA", pc, in->callee->label, "call");
+    emitLabel(returnLabel);
+    for (r = FIRSTTEMP; r <= LASTTEMP; ++r)
+        if (in->saves & (1 << r))
+            emitRM("LD", r, saveSlot[r], fp, "restore register");
+    if (in->dst.kind == IrTemp && reg[in->dst.value] >= FIRSTTEMP)
+        emitRM("LDA", reg[in->dst.value], 0, ac, "copy result");
+    else if (in->dst.kind == IrTemp)
+        keep(in->dst, ac);
+}
+
+/* Procedure genBranch generates the branch ending
+ * block b, falling through to the next block when
+ * it is a target
+ */
+static void genBranch(IrBlock b, IrInstr in)
+{
+    IrOpcode relation = in->relation;
+    int r = compare(in->a, in->b, &relation, ac);
+    if (b->succ[1] == next)
+        emitRM_Label(jumpOf(relation), r, blockLabel[b->succ[0]->id], "br if true");
+    else if (b->succ[0] == next)
+        emitRM_Label(jumpOf(inverse(relation)), r, blockLabel[b->succ[1]->id], "br if false");
+    else
+    {
+        emitRM_Label(jumpOf(relation), r, blockLabel[b->succ[0]->id], "br if true");
+        emitRM_Label("LDA", pc, blockLabel[b->succ[1]->id], "jmp if false");
+    }
+}
+
+/* Procedure genReturn returns from the running
+ * function with the value of a
+ */
+static void genReturn(IrOperand a)
+{
+    int r;
+    if (a.kind != IrNone)
+    {
+        r = fetch(a, ac);
+        if (r != ac)
+            emitRM("LDA", ac, 0, r, "copy result");
+    }
+    emitRM("LD", ac1, -1, fp, "load return address");
+    emitRM("LD", fp, 0, fp, "pop frame");
+    emitRM("LDA", pc, 0, ac1, "return");
+}
+
+/* Procedure genInstr generates the instruction in
+ * of block b
+ */
+static void genInstr(IrBlock b, IrInstr in)
+{
+    int t, r, d;
+    switch (in->op)
+    {
+        case IrMove:
+            genMove(in);
             break;
-        case WriteK:
-            /* generate code for expression to write */
-            cGen(tree->child[0]);
-            /* now output it */
-            emitRO("OUT", ac, 0, 0, "write ac");
+
+        case IrAdd:
+        case IrSub:
+        case IrMul:
+        case IrDiv:
+            genArith(in);
             break;
-        default:
+
+        case IrLt:
+        case IrLe:
+        case IrGt:
+        case IrGe:
+        case IrEq:
+        case IrNe:
+            genRelation(in);
             break;
-    }
-} /* genStmt */
-
-/* Procedure genExp generates code at an expression node */
-static void genExp(TreeNode* tree)
-{
-    int loc;
-    TreeNode *p1, *p2;
-    switch (tree->kind.exp)
-    {
-        case ConstK:
-            if (TraceCode)
-                emitComment("-> Const");
-            /* gen code to load integer constant using LDC */
-            emitRM("LDC", ac, tree->attr.val, 0, "load const");
-            if (TraceCode)
-                emitComment("<- Const");
-            break; /* ConstK */
-
-        case IdK:
-            if (TraceCode)
-                emitComment("-> Id");
-            loc = st_lookup(tree->attr.name);
-            emitRM("LD", ac, loc, gp, "load id value");
-            if (TraceCode)
-                emitComment("<- Id");
-            break; /* IdK */
-
-        case OpK:
-            if (TraceCode)
-                emitComment("-> Op");
-            p1 = tree->child[0];
-            p2 = tree->child[1];
-            /* gen code for ac = left arg */
-            cGen(p1);
-            /* gen code to push left operand */
-            emitRM("ST", ac, tmpOffset--, mp, "op: push left");
-            /* gen code for ac = right operand */
-            cGen(p2);
-            /* now load left operand */
-            emitRM("LD", ac1, ++tmpOffset, mp, "op: load left");
-            switch (tree->attr.op)
+
+        case IrLoad:
+            t = target(in->dst);
+            r = address(in->a, in->offset, ac1, &d);
+            emitRM("LD", t, d, r, "load");
+            keep(in->dst, t);
+            break;
+
+        case IrStore:
+            t = fetch(in->a, ac);
+            r = address(in->b, in->offset, ac1, &d);
+            emitRM("ST", t, d, r, "store");
+            break;
+
+        case IrParam:
+            d = -2 - in->offset;
+            if (reg[in->dst.value] >= FIRSTTEMP)
+                emitRM("LD", reg[in->dst.value], d, fp, "load parameter");
+            else if (reg[in->dst.value] == MEMORY && slot[in->dst.value] != d)
             {
-                case PLUS:
-                    emitRO("ADD", ac, ac1, ac, "op +");
-                    break;
-                case MINUS:
-                    emitRO("SUB", ac, ac1, ac, "op -");
-                    break;
-                case TIMES:
-                    emitRO("MUL", ac, ac1, ac, "op *");
-                    break;
-                case OVER:
-                    emitRO("DIV", ac, ac1, ac, "op /");
-                    break;
-                case LT:
-                    emitRO("SUB", ac, ac1, ac, "op <");
-                    emitRM("JLT", ac, 2, pc, "br if true");
-                    emitRM("LDC", ac, 0, ac, "false case");
-                    emitRM("LDA", pc, 1, pc, "unconditional jmp");
-                    emitRM("LDC", ac, 1, ac, "true case");
-                    break;
-                case EQ:
-                    emitRO("SUB", ac, ac1, ac, "op ==");
-                    emitRM("JEQ", ac, 2, pc, "br if true");
-                    emitRM("LDC", ac, 0, ac, "false case");
-                    emitRM("LDA", pc, 1, pc, "unconditional jmp");
-                    emitRM("LDC", ac, 1, ac, "true case");
-                    break;
-                default:
-                    emitComment("BUG: Unknown operator");
-                    break;
-            } /* case op */
-            if (TraceCode)
-                emitComment("<- Op");
-            break; /* OpK */
+                emitRM("LD", ac, d, fp, "load parameter");
+                keep(in->dst, ac);
+            }
+            break;
+
+        case IrCall:
+            genCall(in);
+            break;
+
+        case IrInput:
+            t = target(in->dst);
+            emitRO("IN", t, 0, 0, "read integer value");
+            keep(in->dst, t);
+            break;
+
+        case IrOutput:
+            emitRO("OUT", fetch(in->a, ac), 0, 0, "write value");
+            break;
+
+        case IrJump:
+            if (b->succ[0] != next)
+                emitRM_Label("LDA", pc, blockLabel[b->succ[0]->id], "jmp");
+            break;
+
+        case IrBranch:
+            genBranch(b, in);
+            break;
+
+        case IrReturn:
+            genReturn(in->a);
+            break;
 
         default:
+            emitComment("BUG: Unknown instruction");
             break;
     }
-} /* genExp */
+}
 
-/* Procedure cGen recursively generates code by
- * tree traversal
+/* Procedure layoutFrame gives the slots below the
+ * local arrays to the registers calls save and to
+ * the temps kept in memory, which share slots when
+ * they are never live at the same time. A parameter
+ * kept in memory stays in its own slot. It reports
+ * a frame that does not fit in data memory above
+ * the globals
  */
-static void cGen(TreeNode* tree)
+static void layoutFrame(void)
+{
+    IrInstr in;
+    int i, t, r, spills, saves = 0;
+    frameTop = -2 - function->paramCount - function->frameSize;
+    for (i = 0; i < function->blockCount; ++i)
+        for (in = function->blocks[i]->first; in != NULL; in = in->next)
+            if (in->op == IrCall)
+                saves |= in->saves;
+    for (r = FIRSTTEMP; r <= LASTTEMP; ++r)
+        if (saves & (1 << r))
+            saveSlot[r] = frameTop--;
+    spills = ra_assign_slots(function, reg, slot);
+    for (t = 0; t < function->tempCount; ++t)
+        if (slot[t] >= 0)
+            slot[t] = frameTop - slot[t];
+    for (in = function->blocks[0]->first; in != NULL; in = in->next)
+        if (in->op == IrParam && reg[in->dst.value] == MEMORY)
+            slot[in->dst.value] = -2 - in->offset;
+    frameTop -= spills;
+    if (DADDR_SIZE + frameTop < globalSize)
+    {
+        fprintf(listing, "Code generation error: the frame of function %s takes %d words, more than the %d of data memory above the globals\n",
+                function->name, -frameTop, DADDR_SIZE - globalSize);
+        Error = TRUE;
+    }
+}
+
+/* Procedure genFunction generates the code of f */
+static void genFunction(IrFunction f)
 {
-    if (tree != NULL)
+    IrInstr in;
+    int i;
+    function = f;
+    reg = ra_allocate(f);
+    slot = (int*)malloc((f->tempCount + 1) * sizeof(int));
+    blockLabel = (int*)malloc((f->blockCount + 1) * sizeof(int));
+    if (slot == NULL || blockLabel == NULL)
+    {
+        fprintf(listing, "Out of memory error at line %d\n", lineno);
+        exit(1);
+    }
+    layoutFrame();
+    for (i = 0; i < f->blockCount; ++i)
+        blockLabel[i] = emitNewLabel();
+    if (TraceCode)
     {
-        switch (tree->nodekind)
+        emitComment("-> function");
+        emitComment(f->name);
+    }
+    emitLabel(f->label);
+    emitSymbol(f->name);
+    if (f->blocks[0]->first != NULL)
+        emitLine(f->blocks[0]->first->lineno);
+    emitRM("ST", ac, -1, fp, "store return address");
+    for (i = 0; i < f->blockCount; ++i)
+    {
+        next = i + 1 < f->blockCount ? f->blocks[i + 1] : NULL;
+        emitLabel(blockLabel[i]);
+        for (in = f->blocks[i]->first; in != NULL; in = in->next)
         {
-            case StmtK:
-                genStmt(tree);
-                break;
-            case ExpK:
-                genExp(tree);
-                break;
-            default:
-                break;
+            emitLine(in->lineno);
+            genInstr(f->blocks[i], in);
         }
-        cGen(tree->sibling);
     }
+    if (TraceCode)
+        emitComment("<- function");
+    free(reg);
+    free(slot);
+    free(blockLabel);
 }
 
 /**********************************************/
 /* the primary function of the code generator */
 /**********************************************/
 /* Procedure codeGen generates code to a code
- * file by traversal of the syntax tree. The
- * second parameter (codefile) is the file name
- * of the code file, and is used to print the
- * file name as a comment in the code file
+ * file from program, in SSA form. The second
+ * parameter (codefile) is the file name of the
+ * code file, and is used to print the file name
+ * as a comment in the code file. If binary is
+ * TRUE the code is written in the .tmb format
  */
-void codeGen(TreeNode* syntaxTree, char* codefile)
+void codeGen(IrProgram program, char* codefile, int binary)
 {
     char* s = malloc(strlen(codefile) + 7);
+    IrFunction f;
+    int haltLabel;
+    ir_from_ssa(program);
+    globalSize = program->globalSize;
+    for (f = program->functions; f != NULL; f = f->next)
+        f->label = emitNewLabel();
     strcpy(s, "File: ");
     strcat(s, codefile);
-    emitComment("TINY Compilation to TM Code");
+    emitComment("C-Minus Compilation to TM Code");
     emitComment(s);
+    free(s);
     /* generate standard prelude */
+    haltLabel = emitNewLabel();
     emitComment("Standard prelude:");
-    emitRM("LD", mp, 0, ac, "load maxaddress from location 0");
+    emitRM("LD", fp, 0, ac, "load maxaddress from location 0");
     emitRM("ST", ac, 0, ac, "clear location 0");
-    emitComment("End of standard prelude.");
-    /* generate code for TINY program */
-    cGen(syntaxTree);
-    /* finish */
+    emitRM_Label("LDA", ac, haltLabel, "save return address");
+    emitRM_Label("LDA", pc, program->main->label, "call main");
+    emitLabel(haltLabel);
     emitComment("End of execution.");
     emitRO("HALT", 0, 0, 0, "");
+    emitComment("End of standard prelude.");
+    /* generate code for C-Minus program */
+    for (f = program->functions; f != NULL; f = f->next)
+        genFunction(f);
+    emitFinish(binary);
 }
@@ -1,6 +1,7 @@
 /****************************************************/
 /* File: cgen.h                                     */
-/* The code generator interface to the TINY compiler*/
+/* The code generator interface to the C-Minus      */
+/* compiler                                         */
 /* Compiler Construction: Principles and Practice   */
 /* Kenneth C. Louden                                */
 /****************************************************/
@@ -8,12 +9,16 @@
 #ifndef _CGEN_H_
 #define _CGEN_H_
 
+#include "ir.h"
+
 /* Procedure codeGen generates code to a code
- * file by traversal of the syntax tree. The
- * second parameter (codefile) is the file name
- * of the code file, and is used to print the
- * file name as a comment in the code file
+ * file from program, which it takes out of SSA
+ * form. The second parameter (codefile) is the
+ * file name of the code file, and is used to
+ * print the file name as a comment in the code
+ * file. If binary is TRUE the code is written in
+ * the .tmb format
  */
-void codeGen(TreeNode* syntaxTree, char* codefile);
+void codeGen(IrProgram program, char* codefile, int binary);
 
 #endif
@@ -17,6 +17,7 @@ static char * savedName; /* for use in assignments */
 static int savedNum;     /* ID [ NUM ] */
 static int savedLineNo;  /* ditto */
 static TreeNode * savedTree; /* stores syntax tree for later return */
+static void (*emitDeclaration)(TreeNode *); /* set by parseDeclarations */
 static int yylex(void); // added 11/2/11 to ensure no conflict with lex
 int yyerror(char * message);
 
@@ -40,7 +41,12 @@ program             : declaration_list
 declaration_list    : declaration_list declaration
                       {
                         YYSTYPE t = $1;
-                        if (t != NULL)
+                        if (emitDeclaration != NULL)
+                        {
+                          emitDeclaration($2);
+                          $$ = NULL;
+                        }
+                        else if (t != NULL)
                         {
                           while (t->sibling != NULL)
                           {
@@ -56,7 +62,13 @@ declaration_list    : declaration_list declaration
                       }
                     | declaration
                       {
-                        $$ = $1; 
+                        if (emitDeclaration != NULL)
+                        {
+                          emitDeclaration($1);
+                          $$ = NULL;
+                        }
+                        else
+                          $$ = $1;
                       }
                     ;
 
@@ -76,6 +88,7 @@ var_declaration     : type_specifier saveName SEMI
                         $$->attr.name = savedName;
                         $$->lineno = savedLineNo;
                         $$->type = $1->type;
+                        freeTree($1);
                       }
                     | type_specifier saveName LBRACE saveNum RBRACE SEMI
                       {
@@ -86,6 +99,7 @@ var_declaration     : type_specifier saveName SEMI
                         $$->child[0] = newExpNode(ConstantK);
                         $$->child[0]->attr.val = savedNum;
                         $$->isarray = TRUE;
+                        freeTree($1);
                       }
                     ;
 
@@ -122,6 +136,7 @@ fun_declaration     : type_specifier saveName
                         $$->lineno = savedLineNo;
                         $$->type = $1->type;
                         $$->isarray = $1->isarray;
+                        freeTree($1);
                       }
                       LPAREN params RPAREN compound_stmt
                       {
@@ -170,6 +185,7 @@ param               : type_specifier saveName
                         $$->attr.name = savedName;
                         $$->lineno = savedLineNo;
                         $$->type = $1->type;
+                        freeTree($1);
                       }
                     | type_specifier saveName
                       {
@@ -177,6 +193,7 @@ param               : type_specifier saveName
                         $$->attr.name = savedName;
                         $$->lineno = savedLineNo;
                         $$->type = $1->type;
+                        freeTree($1);
                       }
                       LBRACE RBRACE
                       {
@@ -342,6 +359,7 @@ simple_expression   : additive_expression relop additive_expression
                         $$->attr.op = $2->attr.op;
                         $$->child[0] = $1;
                         $$->child[1] = $3;
+                        freeTree($2);
                       }
                     | additive_expression
                       {
@@ -387,6 +405,7 @@ additive_expression : additive_expression addop term
                         $$->attr.op = $2->attr.op;
                         $$->child[0] = $1;
                         $$->child[1] = $3;
+                        freeTree($2);
                       }
                     | term
                       {
@@ -412,6 +431,7 @@ term                : term mulop factor
                         $$->attr.op = $2->attr.op;
                         $$->child[0] = $1;
                         $$->child[1] = $3;
+                        freeTree($2);
                       }
                     | factor
                       {
@@ -518,3 +538,9 @@ TreeNode * parse(void)
   return savedTree;
 }
 
+void parseDeclarations(void (*emit)(TreeNode *))
+{ emitDeclaration = emit;
+  yyparse();
+  emitDeclaration = NULL;
+}
+
@@ -8,14 +8,98 @@
 
 #include "globals.h"
 #include "code.h"
+#include "tmb.h"
+#include "peephole.h"
+#include "phase.h"
+
+/* the program emitted so far */
+static Instruction* program = NULL;
+static int programSize = 0;
+static int programCapacity = 0;
 
 /* TM location number for current instruction emission */
 static int emitLoc = 0;
 
-/* Highest TM location emitted so far
-   For use in conjunction with emitSkip,
-   emitBackup, and emitRestore */
-static int highEmitLoc = 0;
+/* the line of program each label is placed before,
+ * -1 until it is placed. A label refers to the first
+ * instruction kept from that line on
+ */
+static int* labels = NULL;
+static int labelCount = 0;
+static int labelCapacity = 0;
+
+/* indices in program of the instructions that refer
+ * to a label
+ */
+static int* fixups = NULL;
+static int fixupCount = 0;
+static int fixupCapacity = 0;
+
+/* source line of the instructions emitted next */
+static int emitLineno = 0;
+
+/* names of locations, for the .tmb symbol table */
+static TmbSymbol* symbols = NULL;
+static char** symbolNames = NULL;
+static int symbolCount = 0;
+static int symbolCapacity = 0;
+static int symbolNameCapacity = 0;
+
+/* the TM opcodes by value, as in tm.c */
+static char* opNames[opRALim] = { "HALT", "IN", "OUT", "ADD", "SUB", "MUL", "DIV", "????", "LD", "ST",
+                                  "????", "LDA", "LDC", "JLT", "JLE", "JGT", "JGE", "JEQ", "JNE" };
+
+/* Function grow doubles the capacity of an array of
+ * elements of the given size
+ */
+static void* grow(void* array, int* capacity, size_t size)
+{
+    *capacity = *capacity ? 2 * *capacity : 256;
+    array = realloc(array, *capacity * size);
+    if (array == NULL)
+    {
+        fprintf(listing, "Out of memory error at line %d\n", lineno);
+        exit(1);
+    }
+    return array;
+}
+
+/* Function copyComment keeps c while the program is
+ * buffered; comments are only kept for TraceCode
+ */
+static char* copyComment(char* c)
+{
+    char* copy;
+    if (!TraceCode)
+        return NULL;
+    copy = malloc(strlen(c) + 1);
+    if (copy == NULL)
+    {
+        fprintf(listing, "Out of memory error at line %d\n", lineno);
+        exit(1);
+    }
+    return strcpy(copy, c);
+}
+
+/* Function append adds a line to the program */
+static Instruction* append(char* op, int isRM, char* c)
+{
+    Instruction* in;
+    if (programSize == programCapacity)
+        program = grow(program, &programCapacity, sizeof(Instruction));
+    in = &program[programSize++];
+    in->op = op;
+    in->isRM = isRM;
+    in->deleted = FALSE;
+    in->r = in->s = in->t = in->d = 0;
+    in->loc = emitLoc;
+    in->label = -1;
+    in->lineno = emitLineno;
+    in->comment = copyComment(c);
+    if (op != NULL)
+        ++emitLoc;
+    return in;
+}
 
 /* Procedure emitComment prints a comment line
  * with comment c in the code file
@@ -23,7 +107,7 @@ static int highEmitLoc = 0;
 void emitComment(char* c)
 {
     if (TraceCode)
-        fprintf(code, "* %s\n", c);
+        append(NULL, FALSE, c);
 }
 
 /* Procedure emitRO emits a register-only
@@ -36,12 +120,10 @@ void emitComment(char* c)
  */
 void emitRO(char* op, int r, int s, int t, char* c)
 {
-    fprintf(code, "%3d:  %5s  %d,%d,%d ", emitLoc++, op, r, s, t);
-    if (TraceCode)
-        fprintf(code, "\t%s", c);
-    fprintf(code, "\n");
-    if (highEmitLoc < emitLoc)
-        highEmitLoc = emitLoc;
+    Instruction* in = append(op, FALSE, c);
+    in->r = r;
+    in->s = s;
+    in->t = t;
 } /* emitRO */
 
 /* Procedure emitRM emits a register-to-memory
@@ -54,62 +136,265 @@ void emitRO(char* op, int r, int s, int t, char* c)
  */
 void emitRM(char* op, int r, int d, int s, char* c)
 {
-    fprintf(code, "%3d:  %5s  %d,%d(%d) ", emitLoc++, op, r, d, s);
-    if (TraceCode)
-        fprintf(code, "\t%s", c);
-    fprintf(code, "\n");
-    if (highEmitLoc < emitLoc)
-        highEmitLoc = emitLoc;
+    Instruction* in = append(op, TRUE, c);
+    in->r = r;
+    in->d = d;
+    in->s = s;
 } /* emitRM */
 
-/* Function emitSkip skips "howMany" code
- * locations for later backpatch. It also
- * returns the current code position
+/* Function emitNewLabel returns a new label, to be
+ * placed with emitLabel
+ */
+int emitNewLabel(void)
+{
+    if (labelCount == labelCapacity)
+        labels = grow(labels, &labelCapacity, sizeof(int));
+    labels[labelCount] = -1;
+    return labelCount++;
+}
+
+/* Procedure emitLabel places label at the location
+ * of the next instruction
+ */
+void emitLabel(int label)
+{
+    labels[label] = programSize;
+}
+
+/* Procedure emitRM_Label emits a register-to-memory
+ * TM instruction with a pc-relative reference to
+ * label, resolved by emitFinish
+ * op = the opcode
+ * r = target register
+ * label = the label referred to
+ * c = a comment to be printed if TraceCode is TRUE
+ */
+void emitRM_Label(char* op, int r, int label, char* c)
+{
+    Instruction* in;
+    if (fixupCount == fixupCapacity)
+        fixups = grow(fixups, &fixupCapacity, sizeof(int));
+    fixups[fixupCount++] = programSize;
+    in = append(op, TRUE, c);
+    in->r = r;
+    in->s = pc;
+    in->label = label;
+} /* emitRM_Label */
+
+/* Procedure emitLine tells that the instructions
+ * emitted next come from source line lineno
+ */
+void emitLine(int lineno)
+{
+    emitLineno = lineno;
+}
+
+/* Procedure emitSymbol names the location of the
+ * next instruction, such as a function entry. The
+ * name is not copied
+ */
+void emitSymbol(char* name)
+{
+    if (symbolCount == symbolCapacity)
+        symbols = grow(symbols, &symbolCapacity, sizeof(TmbSymbol));
+    if (symbolCount == symbolNameCapacity)
+        symbolNames = grow(symbolNames, &symbolNameCapacity, sizeof(char*));
+    symbols[symbolCount].loc = programSize; /* a line until emitFinish */
+    symbolNames[symbolCount++] = name;
+}
+
+/* Function opcode returns the value of the TM
+ * opcode named op
  */
-int emitSkip(int howMany)
+static int opcode(char* op)
 {
-    int i = emitLoc;
-    emitLoc += howMany;
-    if (highEmitLoc < emitLoc)
-        highEmitLoc = emitLoc;
+    int i;
+    for (i = 0; i < opRALim; ++i)
+        if (strcmp(opNames[i], op) == 0)
+            return i;
+    fprintf(listing, "BUG in emitFinish: unknown opcode %s\n", op);
+    return opHALT;
+}
+
+/* Function nextInstruction returns the index of the
+ * first instruction kept from line i of the program
+ * on, or programSize
+ */
+static int nextInstruction(int i)
+{
+    while (i < programSize && (program[i].op == NULL || program[i].deleted))
+        ++i;
     return i;
-} /* emitSkip */
+}
 
-/* Procedure emitBackup backs up to
- * loc = a previously skipped location
+/* Function locationOf returns the location of the
+ * first instruction kept from line i on
  */
-void emitBackup(int loc)
+static int locationOf(int i)
 {
-    if (loc > highEmitLoc)
-        emitComment("BUG in emitBackup");
-    emitLoc = loc;
-} /* emitBackup */
+    i = nextInstruction(i);
+    return i < programSize ? program[i].loc : emitLoc;
+}
 
-/* Procedure emitRestore restores the current
- * code position to the highest previously
- * unemitted position
+/* Function writeBinary formats the resolved program
+ * in the .tmb format into text and returns its size
  */
-void emitRestore(void)
+static size_t writeBinary(char** text)
 {
-    emitLoc = highEmitLoc;
+    TmbHeader header;
+    TmbInstruction* in;
+    TmbLine* line;
+    char* p;
+    size_t size;
+    int i, stringSize = 0, lineCount = 0, last = -1;
+    for (i = 0; i < symbolCount; ++i)
+    {
+        symbols[i].name = stringSize;
+        stringSize += strlen(symbolNames[i]) + 1;
+    }
+    for (i = 0; i < programSize; ++i)
+    {
+        if (program[i].op != NULL && !program[i].deleted && program[i].lineno != last)
+        {
+            ++lineCount;
+            last = program[i].lineno;
+        }
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TMB_MAGIC, 4);
+    header.instructionCount = emitLoc;
+    header.symbolCount = symbolCount;
+    header.lineCount = lineCount;
+    header.stringSize = stringSize;
+    size = sizeof(header) + emitLoc * sizeof(TmbInstruction) + symbolCount * sizeof(TmbSymbol) +
+           lineCount * sizeof(TmbLine) + stringSize;
+    p = *text = malloc(size);
+    if (p == NULL)
+    {
+        fprintf(listing, "Out of memory error at line %d\n", lineno);
+        exit(1);
+    }
+    memcpy(p, &header, sizeof(header));
+    in = (TmbInstruction*)(p + sizeof(header));
+    line = (TmbLine*)((char*)(in + emitLoc) + symbolCount * sizeof(TmbSymbol));
+    last = -1;
+    for (i = 0; i < programSize; ++i)
+    {
+        Instruction* e = &program[i];
+        if (e->op == NULL || e->deleted)
+            continue;
+        in->iop = opcode(e->op);
+        in->iarg1 = e->r;
+        in->iarg2 = e->isRM ? e->d : e->s;
+        in->iarg3 = e->isRM ? e->s : e->t;
+        ++in;
+        if (e->lineno != last)
+        {
+            line->loc = e->loc;
+            line->lineno = last = e->lineno;
+            ++line;
+        }
+    }
+    memcpy(in, symbols, symbolCount * sizeof(TmbSymbol));
+    p = (char*)line;
+    for (i = 0; i < symbolCount; ++i)
+    {
+        strcpy(p, symbolNames[i]);
+        p += strlen(symbolNames[i]) + 1;
+    }
+    return size;
 }
 
-/* Procedure emitRM_Abs converts an absolute reference
- * to a pc-relative reference when emitting a
- * register-to-memory TM instruction
- * op = the opcode
- * r = target register
- * a = the absolute location in memory
- * c = a comment to be printed if TraceCode is TRUE
+/* Function writeText formats the resolved program
+ * as text into text and returns its size
  */
-void emitRM_Abs(char* op, int r, int a, char* c)
+static size_t writeText(char** text)
 {
-    fprintf(
-        code, "%3d:  %5s  %d,%d(%d) ", emitLoc, op, r, a - (emitLoc + 1), pc);
-    ++emitLoc;
-    if (TraceCode)
-        fprintf(code, "\t%s", c);
-    fprintf(code, "\n");
-    if (highEmitLoc < emitLoc)
-        highEmitLoc = emitLoc;
-} /* emitRM_Abs */
+    char* p;
+    size_t size = 0, capacity = 0;
+    int i;
+    for (i = 0; i < programSize; ++i)
+        capacity += 48 + (program[i].comment ? strlen(program[i].comment) : 0);
+    p = *text = malloc(capacity + 1);
+    if (p == NULL)
+    {
+        fprintf(listing, "Out of memory error at line %d\n", lineno);
+        exit(1);
+    }
+    for (i = 0; i < programSize; ++i)
+    {
+        Instruction* in = &program[i];
+        if (in->deleted)
+            continue;
+        if (in->op == NULL)
+            size += sprintf(p + size, "* %s\n", in->comment);
+        else
+        {
+            if (in->isRM)
+                size += sprintf(p + size, "%3d:  %5s  %d,%d(%d) ", in->loc, in->op, in->r, in->d, in->s);
+            else
+                size += sprintf(p + size, "%3d:  %5s  %d,%d,%d ", in->loc, in->op, in->r, in->s, in->t);
+            if (in->comment != NULL)
+                size += sprintf(p + size, "\t%s", in->comment);
+            p[size++] = '\n';
+        }
+    }
+    return size;
+}
+
+/* Procedure emitFinish resolves the references to
+ * labels, writes the program to the code file in a
+ * single write and resets the emitter. If binary is
+ * TRUE the program is written in the .tmb format of
+ * tmb.h, with its symbols and source lines
+ */
+void emitFinish(int binary)
+{
+    char* text;
+    size_t size;
+    int i;
+    for (i = 0; i < labelCount; ++i)
+        if (labels[i] >= 0)
+            labels[i] = nextInstruction(labels[i]);
+    pp_run(program, programSize, labels, labelCount);
+    /* number the instructions that are kept */
+    emitLoc = 0;
+    for (i = 0; i < programSize; ++i)
+        if (program[i].op != NULL && !program[i].deleted)
+            program[i].loc = emitLoc++;
+    for (i = 0; i < symbolCount; ++i)
+        symbols[i].loc = locationOf(symbols[i].loc);
+    /* the pc has moved past the instruction */
+    for (i = 0; i < fixupCount; ++i)
+    {
+        Instruction* in = &program[fixups[i]];
+        if (labels[in->label] < 0)
+            fprintf(listing, "BUG in emitFinish: label %d is not placed\n", in->label);
+        in->d = locationOf(labels[in->label]) - (in->loc + 1);
+    }
+    /* writing the code file is output, not code
+     * generation
+     */
+    ph_push(OutputPhase);
+    size = binary ? writeBinary(&text) : writeText(&text);
+    fwrite(text, 1, size, code);
+    free(text);
+    ph_pop();
+    for (i = 0; i < programSize; ++i)
+        free(program[i].comment);
+    free(program);
+    free(labels);
+    free(fixups);
+    free(symbols);
+    free(symbolNames);
+    program = NULL;
+    labels = fixups = NULL;
+    symbols = NULL;
+    symbolNames = NULL;
+    programSize = programCapacity = 0;
+    labelCount = labelCapacity = 0;
+    fixupCount = fixupCapacity = 0;
+    symbolCount = symbolCapacity = symbolNameCapacity = 0;
+    emitLoc = 0;
+    emitLineno = 0;
+} /* emitFinish */
@@ -12,24 +12,57 @@
 /* pc = program counter  */
 #define pc 7
 
-/* mp = "memory pointer" points
- * to top of memory (for temp storage)
+/* fp = "frame pointer" points to the
+ * activation record of the running function;
+ * frames grow down from the top of memory
  */
-#define mp 6
+#define fp 6
 
 /* gp = "global pointer" points
  * to bottom of memory for (global)
- * variable storage
+ * variable storage. It stays 0, so the
+ * location of a global is its address
  */
 #define gp 5
 
 /* accumulator */
 #define ac 0
 
-/* 2nd accumulator */
+/* 2nd accumulator. It is scratch: a value put in
+ * ac1 is dead once an instruction has read it into
+ * another register
+ */
 #define ac1 1
 
-/* code emitting utilities */
+/* registers FIRSTTEMP..LASTTEMP are given to
+ * temps by the register allocator; a caller saves
+ * the ones live across a call
+ */
+#define FIRSTTEMP 2
+#define LASTTEMP 4
+
+/* Instruction is an emitted TM instruction, or a
+ * comment line if op is NULL. A register-only
+ * instruction uses r, s and t; a register-to-memory
+ * one uses r, d and s. Passes over the emitted code
+ * delete an instruction by marking it
+ */
+typedef struct
+{
+    char* op;
+    int isRM;
+    int deleted;
+    int loc;
+    int r, s, t, d;
+    int label; /* label d refers to, or -1 */
+    int lineno;
+    char* comment;
+} Instruction;
+
+/* code emitting utilities. Instructions are kept
+ * in memory until emitFinish writes the program,
+ * so jumps can refer to labels placed later
+ */
 
 /* Procedure emitComment prints a comment line
  * with comment c in the code file
@@ -56,31 +89,43 @@ void emitRO(char* op, int r, int s, int t, char* c);
  */
 void emitRM(char* op, int r, int d, int s, char* c);
 
-/* Function emitSkip skips "howMany" code
- * locations for later backpatch. It also
- * returns the current code position
- */
-int emitSkip(int howMany);
-
-/* Procedure emitBackup backs up to
- * loc = a previously skipped location
+/* Function emitNewLabel returns a new label, to be
+ * placed with emitLabel
  */
-void emitBackup(int loc);
+int emitNewLabel(void);
 
-/* Procedure emitRestore restores the current
- * code position to the highest previously
- * unemitted position
+/* Procedure emitLabel places label at the location
+ * of the next instruction
  */
-void emitRestore(void);
+void emitLabel(int label);
 
-/* Procedure emitRM_Abs converts an absolute reference
- * to a pc-relative reference when emitting a
- * register-to-memory TM instruction
+/* Procedure emitRM_Label emits a register-to-memory
+ * TM instruction with a pc-relative reference to
+ * label, resolved by emitFinish
  * op = the opcode
  * r = target register
- * a = the absolute location in memory
+ * label = the label referred to
  * c = a comment to be printed if TraceCode is TRUE
  */
-void emitRM_Abs(char* op, int r, int a, char* c);
+void emitRM_Label(char* op, int r, int label, char* c);
+
+/* Procedure emitLine tells that the instructions
+ * emitted next come from source line lineno
+ */
+void emitLine(int lineno);
+
+/* Procedure emitSymbol names the location of the
+ * next instruction, such as a function entry. The
+ * name is not copied
+ */
+void emitSymbol(char* name);
+
+/* Procedure emitFinish resolves the references to
+ * labels, writes the program to the code file in a
+ * single write and resets the emitter. If binary is
+ * TRUE the program is written in the .tmb format of
+ * tmb.h, with its symbols and source lines
+ */
+void emitFinish(int binary);
 
 #endif
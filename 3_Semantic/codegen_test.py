@@ -0,0 +1,39 @@
+import os
+import re
+import subprocess
+
+def expected(path, key):
+    with open(path, 'r') as f:
+        for line in f.readlines():
+            if f'/* {key}:' in line:
+                return re.sub(r'.*/\* ' + key + r':(.*)\*/.*', r'\1', line).split()
+    return []
+
+def main():
+    cases = os.listdir('./test_case_c')
+    print(cases)
+
+    for case in sorted(cases):
+        path = './test_case_c/' + str(case)
+        for mode in ['tm', 'tmb', 'no-peephole']:
+            emit = 'tmb' if mode == 'tmb' else 'tm'
+            options = ['--no-peephole'] if mode == 'no-peephole' else []
+            codefile = path[:path.rfind('.')] + '.' + emit
+            proc = subprocess.run(['./cminus_semantic', '--stop-after=codegen', '--emit=' + emit] + options + [path], capture_output=True)
+            r = proc.stdout.decode('utf-8')
+            if proc.returncode != 0 or 'error' in r:
+                print(f'테스트 실패: {case} ({mode}) \n{r}')
+                continue
+
+            stdin = 'g\n' + '\n'.join(expected(path, 'input')) + '\nq\n'
+            proc = subprocess.run(['./tm', codefile], input=stdin.encode('utf-8'), capture_output=True)
+            os.remove(codefile)
+            r = proc.stdout.decode('utf-8')
+            out = re.findall(r'OUT instruction prints: (-?[0-9]+)', r)
+            if out != expected(path, 'output'):
+                print(f'테스트 실패: {case} ({mode}) {out} != {expected(path, "output")}\n{r}')
+            else:
+                print(f"테스트 성공: {case} ({mode})")
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,165 @@
+/****************************************************/
+/* File: events.c                                   */
+/* Trace event implementation                       */
+/* for the C-Minus compiler                         */
+/* Every thread records into a buffer of its own;   */
+/* the buffers are written out as JSON at the end   */
+/****************************************************/
+
+#include <pthread.h>
+#include <time.h>
+#include "globals.h"
+#include "events.h"
+
+/* MAXEVENTNAME is the longest name kept of a span */
+#define MAXEVENTNAME 40
+
+typedef struct
+{
+    char type; /* 'B', 'E' or 'i' */
+    const char* cat;
+    char name[MAXEVENTNAME + 1];
+    double ts; /* microseconds since ev_open */
+} Event;
+
+typedef struct EventBufferRec
+{
+    Event* events;
+    int count;
+    int capacity;
+    int tid;
+    struct EventBufferRec* next;
+} EventBuffer;
+
+static FILE* out = NULL;
+static double origin;
+
+/* the buffers of all threads, newest first */
+static pthread_mutex_t buffersLock = PTHREAD_MUTEX_INITIALIZER;
+static EventBuffer* buffers = NULL;
+static int threads = 0;
+
+static _Thread_local EventBuffer* local = NULL;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+int ev_open(const char* filename)
+{
+    out = fopen(filename, "w");
+    origin = now();
+    return out != NULL;
+}
+
+/* Function localBuffer returns the buffer of the
+ * calling thread, registering it on first use
+ */
+static EventBuffer* localBuffer(void)
+{
+    if (local == NULL)
+    {
+        local = (EventBuffer*)calloc(1, sizeof(EventBuffer));
+        if (local == NULL)
+        {
+            fprintf(listing, "Out of memory error at line %d\n", lineno);
+            exit(1);
+        }
+        pthread_mutex_lock(&buffersLock);
+        local->tid = threads++;
+        local->next = buffers;
+        buffers = local;
+        pthread_mutex_unlock(&buffersLock);
+    }
+    return local;
+}
+
+static void record(char type, const char* cat, const char* name)
+{
+    EventBuffer* b = localBuffer();
+    Event* e;
+    if (b->count == b->capacity)
+    {
+        b->capacity = b->capacity ? 2 * b->capacity : 1024;
+        b->events = (Event*)realloc(b->events, b->capacity * sizeof(Event));
+        if (b->events == NULL)
+        {
+            fprintf(listing, "Out of memory error at line %d\n", lineno);
+            exit(1);
+        }
+    }
+    e = &b->events[b->count++];
+    e->type = type;
+    e->cat = cat;
+    strncpy(e->name, name, MAXEVENTNAME);
+    e->name[MAXEVENTNAME] = '\0';
+    e->ts = now() - origin;
+}
+
+void ev_begin(const char* cat, const char* name)
+{
+    if (out != NULL)
+        record('B', cat, name);
+}
+
+void ev_end(void)
+{
+    if (out != NULL)
+        record('E', "", "");
+}
+
+void ev_instant(const char* cat, const char* name)
+{
+    if (out != NULL)
+        record('i', cat, name);
+}
+
+/* names are C-Minus identifiers or fixed strings,
+ * so they need no escaping
+ */
+static void writeEvent(const Event* e, int tid, int* first)
+{
+    fprintf(out, "%s\n{\"ph\": \"%c\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f",
+            *first ? "" : ",", e->type, tid, e->ts);
+    if (e->type != 'E')
+        fprintf(out, ", \"cat\": \"%s\", \"name\": \"%s\"", e->cat, e->name);
+    if (e->type == 'i')
+        fprintf(out, ", \"s\": \"t\"");
+    fprintf(out, "}");
+    *first = FALSE;
+}
+
+void ev_close(void)
+{
+    EventBuffer* b;
+    int first = TRUE;
+    int i;
+    if (out == NULL)
+        return;
+    fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    while (buffers != NULL)
+    {
+        char label[32];
+        b = buffers;
+        if (b->tid == 0)
+            strcpy(label, "main");
+        else
+            sprintf(label, "thread %d", b->tid);
+        fprintf(out, "%s\n{\"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"name\": \"thread_name\", "
+                     "\"args\": {\"name\": \"%s\"}}",
+                first ? "" : ",", b->tid, label);
+        first = FALSE;
+        for (i = 0; i < b->count; ++i)
+            writeEvent(&b->events[i], b->tid, &first);
+        buffers = b->next;
+        free(b->events);
+        free(b);
+    }
+    fprintf(out, "\n]}\n");
+    fclose(out);
+    out = NULL;
+    local = NULL;
+}
@@ -0,0 +1,35 @@
+/****************************************************/
+/* File: events.h                                   */
+/* Trace event interface for the C-Minus compiler   */
+/* (--trace-out, Chrome trace event format)         */
+/****************************************************/
+
+#ifndef _EVENTS_H_
+#define _EVENTS_H_
+
+/* Function ev_open starts recording events for
+ * filename; it returns FALSE if the file cannot be
+ * created. Until then every other procedure only
+ * tests a flag
+ */
+int ev_open(const char* filename);
+
+/* Procedures ev_begin and ev_end open and close a
+ * span named name of category cat on the calling
+ * thread. Spans of a thread nest
+ */
+void ev_begin(const char* cat, const char* name);
+void ev_end(void);
+
+/* Procedure ev_instant records a point in time on
+ * the calling thread
+ */
+void ev_instant(const char* cat, const char* name);
+
+/* Procedure ev_close writes the events of every
+ * thread to the file and closes it. It must not
+ * run while other threads record events
+ */
+void ev_close(void);
+
+#endif
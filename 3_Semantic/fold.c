@@ -0,0 +1,202 @@
+/****************************************************/
+/* File: fold.c                                     */
+/* Constant folding and algebraic simplification    */
+/* of the syntax tree for the C-Minus compiler      */
+/****************************************************/
+
+#include <limits.h>
+#include "globals.h"
+#include "util.h"
+#include "fold.h"
+
+static int isConstant(TreeNode* t, int val)
+{
+    return t->nodekind == ExpK && t->kind.exp == ConstantK && t->attr.val == val;
+}
+
+static int isLiteral(TreeNode* t)
+{
+    return t->nodekind == ExpK && t->kind.exp == ConstantK;
+}
+
+/* Function isPure tells whether the expression t
+ * may be dropped: it calls and assigns nothing, and
+ * divides only by constants that cannot trap
+ */
+static int isPure(TreeNode* t)
+{
+    int i;
+    if (t == NULL)
+        return TRUE;
+    if (t->nodekind == ExpK && (t->kind.exp == CallK || t->kind.exp == AssignmentK))
+        return FALSE;
+    if (t->nodekind == ExpK && t->kind.exp == OperatorK && t->attr.op == OVER &&
+        (!isLiteral(t->child[1]) || t->child[1]->attr.val == 0 || t->child[1]->attr.val == -1))
+        return FALSE;
+    for (i = 0; i < MAXCHILDREN; ++i)
+        if (!isPure(t->child[i]))
+            return FALSE;
+    return TRUE;
+}
+
+/* Function sameVariable tells whether a and b read
+ * the same variable, or the same element by a
+ * constant index
+ */
+static int sameVariable(TreeNode* a, TreeNode* b)
+{
+    if (a->nodekind != ExpK || a->kind.exp != VarK || b->nodekind != ExpK ||
+        b->kind.exp != VarK || a->symbol != b->symbol || a->symbol == NULL)
+        return FALSE;
+    if (a->child[0] == NULL || b->child[0] == NULL)
+        return a->child[0] == b->child[0];
+    return isLiteral(a->child[0]) && isLiteral(b->child[0]) &&
+           a->child[0]->attr.val == b->child[0]->attr.val;
+}
+
+/* Function evaluate computes a op b into *val and
+ * returns FALSE if it must be left to run time.
+ * Arithmetic wraps around as in the TM
+ */
+static int evaluate(TokenType op, int a, int b, int* val)
+{
+    switch (op)
+    {
+        case PLUS:
+            *val = (int)((unsigned)a + (unsigned)b);
+            return TRUE;
+        case MINUS:
+            *val = (int)((unsigned)a - (unsigned)b);
+            return TRUE;
+        case TIMES:
+            *val = (int)((unsigned)a * (unsigned)b);
+            return TRUE;
+        case OVER:
+            if (b == 0 || (b == -1 && a == INT_MIN))
+                return FALSE;
+            *val = a / b;
+            return TRUE;
+        case LT:
+            *val = a < b;
+            return TRUE;
+        case LE:
+            *val = a <= b;
+            return TRUE;
+        case GT:
+            *val = a > b;
+            return TRUE;
+        case GE:
+            *val = a >= b;
+            return TRUE;
+        case EQ:
+            *val = a == b;
+            return TRUE;
+        case NE:
+            *val = a != b;
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+/* Function replace returns the child c of t in its
+ * place, and frees t
+ */
+static TreeNode* replace(TreeNode* t, TreeNode* c)
+{
+    int i;
+    c->sibling = t->sibling;
+    t->sibling = NULL;
+    for (i = 0; i < MAXCHILDREN; ++i)
+        if (t->child[i] == c)
+            t->child[i] = NULL;
+    freeTree(t);
+    return c;
+}
+
+/* Procedure makeConstant turns t into the
+ * constant val
+ */
+static void makeConstant(TreeNode* t, int val)
+{
+    int i;
+    for (i = 0; i < MAXCHILDREN; ++i)
+    {
+        freeTree(t->child[i]);
+        t->child[i] = NULL;
+    }
+    t->kind.exp = ConstantK;
+    t->attr.val = val;
+    t->type = Integer;
+}
+
+/* Function simplify folds the operator t, whose
+ * operands are folded, and returns the node that
+ * takes its place
+ */
+static TreeNode* simplify(TreeNode* t)
+{
+    TreeNode* a = t->child[0];
+    TreeNode* b = t->child[1];
+    int val;
+    if (isLiteral(a) && isLiteral(b))
+    {
+        if (evaluate(t->attr.op, a->attr.val, b->attr.val, &val))
+            makeConstant(t, val);
+        return t;
+    }
+    switch (t->attr.op)
+    {
+        case PLUS:
+            if (isConstant(b, 0))
+                return replace(t, a);
+            if (isConstant(a, 0))
+                return replace(t, b);
+            break;
+        case MINUS:
+            if (isConstant(b, 0))
+                return replace(t, a);
+            if (sameVariable(a, b) && isPure(a))
+                makeConstant(t, 0);
+            break;
+        case TIMES:
+            if (isConstant(b, 1))
+                return replace(t, a);
+            if (isConstant(a, 1))
+                return replace(t, b);
+            if ((isConstant(a, 0) && isPure(b)) || (isConstant(b, 0) && isPure(a)))
+                makeConstant(t, 0);
+            break;
+        case OVER:
+            if (isConstant(b, 1))
+                return replace(t, a);
+            break;
+        default:
+            break;
+    }
+    return t;
+}
+
+/* Function foldList folds the list of nodes t and
+ * returns its new head
+ */
+static TreeNode* foldList(TreeNode* t)
+{
+    TreeNode** link = &t;
+    int i;
+    while (*link != NULL)
+    {
+        TreeNode* n = *link;
+        for (i = 0; i < MAXCHILDREN; ++i)
+            n->child[i] = foldList(n->child[i]);
+        if (n->nodekind == ExpK && n->kind.exp == OperatorK)
+            *link = simplify(n);
+        link = &(*link)->sibling;
+    }
+    return t;
+}
+
+void foldConstants(TreeNode* syntaxTree)
+{
+    foldList(syntaxTree);
+}
@@ -0,0 +1,21 @@
+/****************************************************/
+/* File: fold.h                                     */
+/* Constant folding interface for the C-Minus       */
+/* compiler                                         */
+/****************************************************/
+
+#ifndef _FOLD_H_
+#define _FOLD_H_
+
+#include "globals.h"
+
+/* Procedure foldConstants replaces, in the checked
+ * syntax tree, the operators whose operands are
+ * constants by their values, and simplifies x+0,
+ * x-0, x*1, x/1, x*0 and x-x. Operands with side
+ * effects are kept, and so is a division by a
+ * constant 0, which traps when it is run
+ */
+void foldConstants(TreeNode* syntaxTree);
+
+#endif
@@ -136,6 +136,7 @@ typedef struct treeNode
     ExpType type; /* for type checking of exps */
     int isarray;
     struct ScopeListRec* scope;
+    struct BucketListRec* symbol; /* declaration a VarK or CallK resolves to */
 } TreeNode;
 
 /**************************************************/
@@ -165,6 +166,11 @@ extern int TraceParse;
  */
 extern int TraceAnalyze;
 
+/* TraceIr = TRUE causes the intermediate code to
+ * be printed to the listing file in SSA form
+ */
+extern int TraceIr;
+
 /* TraceCode = TRUE causes comments to be written
  * to the TM code file as code is generated
  */
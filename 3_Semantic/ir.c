@@ -0,0 +1,1113 @@
+/****************************************************/
+/* File: ir.c                                       */
+/* Intermediate representation implementation and   */
+/* lowering of the syntax tree for the C-Minus      */
+/* compiler                                         */
+/****************************************************/
+
+#include "globals.h"
+#include "ir.h"
+
+static void* allocOrDie(size_t size)
+{
+    void* p = calloc(1, size);
+    if (p == NULL)
+    {
+        fprintf(listing, "Out of memory error at line %d\n", lineno);
+        exit(1);
+    }
+    return p;
+}
+
+static void* growOrDie(void* array, int* capacity, size_t size)
+{
+    *capacity = *capacity ? 2 * *capacity : 8;
+    array = realloc(array, *capacity * size);
+    if (array == NULL)
+    {
+        fprintf(listing, "Out of memory error at line %d\n", lineno);
+        exit(1);
+    }
+    return array;
+}
+
+int ir_new_temp(IrFunction f)
+{
+    return f->tempCount++;
+}
+
+IrInstr ir_new_instr(IrOpcode op, int lineno)
+{
+    IrInstr in = (IrInstr)allocOrDie(sizeof(struct IrInstrRec));
+    in->op = op;
+    in->lineno = lineno;
+    return in;
+}
+
+void ir_insert_before(IrBlock b, IrInstr before, IrInstr in)
+{
+    in->next = before;
+    in->prev = before != NULL ? before->prev : b->last;
+    if (in->prev != NULL)
+        in->prev->next = in;
+    else
+        b->first = in;
+    if (before != NULL)
+        before->prev = in;
+    else
+        b->last = in;
+}
+
+void ir_remove(IrBlock b, IrInstr in)
+{
+    if (in->prev != NULL)
+        in->prev->next = in->next;
+    else
+        b->first = in->next;
+    if (in->next != NULL)
+        in->next->prev = in->prev;
+    else
+        b->last = in->prev;
+    free(in->args);
+    free(in);
+}
+
+IrBlock ir_new_block(int depth)
+{
+    IrBlock b = (IrBlock)allocOrDie(sizeof(struct IrBlockRec));
+    b->depth = depth;
+    return b;
+}
+
+void ir_place_block(IrFunction f, IrBlock b, int index)
+{
+    int i;
+    if (f->blockCount == f->blockCapacity)
+        f->blocks = growOrDie(f->blocks, &f->blockCapacity, sizeof(IrBlock));
+    for (i = f->blockCount++; i > index; --i)
+        f->blocks[i] = f->blocks[i - 1];
+    f->blocks[index] = b;
+    for (i = index; i < f->blockCount; ++i)
+        f->blocks[i]->id = i;
+}
+
+void ir_add_pred(IrBlock b, IrBlock p)
+{
+    if (b->predCount == b->predCapacity)
+        b->pred = growOrDie(b->pred, &b->predCapacity, sizeof(IrBlock));
+    b->pred[b->predCount++] = p;
+}
+
+/* Function mirrored returns the operation of b
+ * and a that computes a op b, or IrMove if there
+ * is none
+ */
+static IrOpcode mirrored(IrOpcode op)
+{
+    switch (op)
+    {
+        case IrAdd:
+        case IrMul:
+        case IrEq:
+        case IrNe:
+            return op;
+        case IrLt:
+            return IrGt;
+        case IrLe:
+            return IrGe;
+        case IrGt:
+            return IrLt;
+        case IrGe:
+            return IrLe;
+        default:
+            return IrMove;
+    }
+}
+
+void ir_order_operands(IrInstr in)
+{
+    IrOperand a = in->a;
+    IrOpcode* op = in->op == IrBranch ? &in->relation : &in->op;
+    if (a.kind != IrConst || in->b.kind == IrConst || mirrored(*op) == IrMove)
+        return;
+    *op = mirrored(*op);
+    in->a = in->b;
+    in->b = a;
+}
+
+int ir_is_pure(IrInstr in)
+{
+    switch (in->op)
+    {
+        case IrMove:
+        case IrAdd:
+        case IrSub:
+        case IrMul:
+        case IrLt:
+        case IrLe:
+        case IrGt:
+        case IrGe:
+        case IrEq:
+        case IrNe:
+        case IrParam:
+        case IrPhi:
+            return TRUE;
+        default:
+            /* a division may trap, a load may fault */
+            return FALSE;
+    }
+}
+
+/************************************************/
+/* lowering of the syntax tree                  */
+/************************************************/
+
+/* symtab is the version the tree was checked in */
+static Symtab symtab;
+
+/* scope is the innermost scope of the code being
+ * lowered, for names not resolved by the checker
+ */
+static ScopeList scope;
+
+/* the function and the block being lowered, and
+ * the number of loops around the block
+ */
+static IrFunction function;
+static IrBlock current;
+static int depth;
+
+/* Location is where lowering puts a declaration:
+ * the number of a variable, the first slot of an
+ * array (a global location or a frame offset), or
+ * the index of a function in callees
+ */
+typedef struct
+{
+    BucketList symbol;
+    int location;
+} Location;
+
+/* locations is a hash table of the Location of the
+ * declarations lowered so far, by symbol. It is
+ * kept here because the symbol tables may be shared
+ * with other versions and are only read
+ */
+static Location* locations;
+static int locationMask;
+static int locationCount;
+
+/* callees[i] is the function at location i */
+static IrFunction* callees;
+
+/* arrayTop is the offset of the next free slot for
+ * the local arrays of the function
+ */
+static int arrayTop;
+
+/* paramEnd is the offset below the last parameter */
+static int paramEnd;
+
+/* header is the block after the parameters of the
+ * function, that its tail calls jump to
+ */
+static IrBlock header;
+
+static IrOperand operand(IrOperandKind kind, int value)
+{
+    IrOperand o;
+    o.kind = kind;
+    o.value = value;
+    return o;
+}
+
+static IrOperand newTemp(void)
+{
+    return operand(IrTemp, ir_new_temp(function));
+}
+
+/* Function findSlot returns the slot of locations
+ * holding b, or the empty slot where b goes
+ */
+static int findSlot(BucketList b)
+{
+    unsigned long h = (unsigned long)b / sizeof(struct BucketListRec);
+    int j = (int)((h * 2654435761UL) & locationMask);
+    while (locations[j].symbol != NULL && locations[j].symbol != b)
+        j = (j + 1) & locationMask;
+    return j;
+}
+
+/* Procedure setLocation gives b the location loc */
+static void setLocation(BucketList b, int loc)
+{
+    int j;
+    if (++locationCount * 2 > locationMask)
+    {
+        Location* old = locations;
+        int size = locationMask + 1, i;
+        locations = (Location*)allocOrDie(size * 2 * sizeof(Location));
+        locationMask = size * 2 - 1;
+        for (i = 0; i < size; ++i)
+            if (old[i].symbol != NULL)
+                locations[findSlot(old[i].symbol)] = old[i];
+        free(old);
+    }
+    j = findSlot(b);
+    locations[j].symbol = b;
+    locations[j].location = loc;
+}
+
+/* Function locationOf returns the location given
+ * to b by setLocation
+ */
+static int locationOf(BucketList b)
+{
+    return locations[findSlot(b)].location;
+}
+
+/* Function symbolOf returns the declaration the
+ * VarK or CallK node t refers to
+ */
+static BucketList symbolOf(TreeNode* t)
+{
+    if (t->symbol == NULL)
+        t->symbol = st_resolve(symtab, scope, t->attr.name);
+    return t->symbol;
+}
+
+static int isGlobal(BucketList b)
+{
+    return b->scope == symtab->global;
+}
+
+/* Function isVariable tells whether b is lowered to
+ * a variable: a scalar local, or an array parameter
+ * holding the address of the array. The location
+ * of a variable is its number; the local arrays
+ * have negative frame offsets
+ */
+static int isVariable(BucketList b)
+{
+    return !isGlobal(b) && (!b->isarray || locationOf(b) >= 0);
+}
+
+/* Function hasAssign tells whether evaluating t
+ * assigns a variable
+ */
+static int hasAssign(TreeNode* t)
+{
+    int i;
+    for (; t != NULL; t = t->sibling)
+    {
+        if (t->nodekind == ExpK && t->kind.exp == AssignmentK)
+            return TRUE;
+        for (i = 0; i < MAXCHILDREN; ++i)
+            if (hasAssign(t->child[i]))
+                return TRUE;
+    }
+    return FALSE;
+}
+
+/* Function newVariable returns the number of a new
+ * variable called name
+ */
+static int newVariable(char* name)
+{
+    if (function->varCount == function->varCapacity)
+        function->varNames = growOrDie(function->varNames, &function->varCapacity, sizeof(char*));
+    function->varNames[function->varCount] = name;
+    return function->varCount++;
+}
+
+/* Function emit appends a new instruction to the
+ * current block
+ */
+static IrInstr emit(IrOpcode op, int lineno)
+{
+    IrInstr in = ir_new_instr(op, lineno);
+    ir_insert_before(current, NULL, in);
+    return in;
+}
+
+/* Function emitOp appends dst = a op b and returns
+ * dst, a new temp
+ */
+static IrOperand emitOp(IrOpcode op, IrOperand a, IrOperand b, int lineno)
+{
+    IrInstr in = emit(op, lineno);
+    in->dst = newTemp();
+    in->a = a;
+    in->b = b;
+    ir_order_operands(in);
+    return in->dst;
+}
+
+static IrOperand emitLoad(IrOperand base, int offset, int lineno)
+{
+    IrInstr in = emit(IrLoad, lineno);
+    in->dst = newTemp();
+    in->a = base;
+    in->offset = offset;
+    return in->dst;
+}
+
+static void emitStore(IrOperand value, IrOperand base, int offset, int lineno)
+{
+    IrInstr in = emit(IrStore, lineno);
+    in->a = value;
+    in->b = base;
+    in->offset = offset;
+}
+
+/* Procedure place makes b the current block */
+static void place(IrBlock b)
+{
+    ir_place_block(function, b, function->blockCount);
+    current = b;
+}
+
+static void emitJump(IrBlock to, int lineno)
+{
+    emit(IrJump, lineno);
+    current->succ[0] = to;
+    current->succCount = 1;
+}
+
+/* Function pin copies the variable o to a temp if
+ * evaluating later may assign it; a variable
+ * operand reads the variable where it is used
+ */
+static IrOperand pin(IrOperand o, TreeNode* later, int lineno)
+{
+    IrInstr in;
+    if (o.kind != IrVar || !hasAssign(later))
+        return o;
+    in = emit(IrMove, lineno);
+    in->dst = newTemp();
+    in->a = o;
+    return in->dst;
+}
+
+static IrOperand lowerExp(TreeNode* t);
+
+/* Function element lowers the address of the
+ * element of b at index to a base operand and
+ * *offset, as in a load
+ */
+static IrOperand element(BucketList b, TreeNode* index, int* offset)
+{
+    IrOperand i = lowerExp(index);
+    if (isGlobal(b))
+    {
+        if (i.kind == IrConst)
+        {
+            *offset = 0;
+            return operand(IrConst, locationOf(b) + i.value);
+        }
+        *offset = locationOf(b);
+        return i;
+    }
+    if (!isVariable(b))
+    {
+        *offset = locationOf(b);
+        if (i.kind == IrConst)
+        {
+            *offset += i.value;
+            return operand(IrFrame, 0);
+        }
+        return emitOp(IrAdd, i, operand(IrFrame, 0), index->lineno);
+    }
+    /* an array parameter holds the address */
+    if (i.kind == IrConst)
+    {
+        *offset = i.value;
+        return operand(IrVar, locationOf(b));
+    }
+    *offset = 0;
+    return emitOp(IrAdd, i, operand(IrVar, locationOf(b)), index->lineno);
+}
+
+/* Function lowerVar lowers the variable t, not
+ * indexed: its value, or the address of an array
+ */
+static IrOperand lowerVar(TreeNode* t)
+{
+    BucketList b = symbolOf(t);
+    if (isVariable(b))
+        return operand(IrVar, locationOf(b));
+    if (isGlobal(b))
+    {
+        if (b->isarray)
+            return operand(IrConst, locationOf(b));
+        return emitLoad(operand(IrConst, locationOf(b)), 0, t->lineno);
+    }
+    return emitOp(IrAdd, operand(IrFrame, 0), operand(IrConst, locationOf(b)), t->lineno);
+}
+
+static IrOperand lowerAssign(TreeNode* t)
+{
+    TreeNode* target = t->child[0];
+    BucketList b = symbolOf(target);
+    IrOperand base, value;
+    IrInstr in;
+    int offset;
+    if (target->child[0] != NULL)
+    {
+        base = element(b, target->child[0], &offset);
+        base = pin(base, t->child[1], t->lineno);
+        value = lowerExp(t->child[1]);
+        emitStore(value, base, offset, t->lineno);
+        return value;
+    }
+    value = lowerExp(t->child[1]);
+    if (!isVariable(b))
+    {
+        emitStore(value, operand(IrConst, locationOf(b)), 0, t->lineno);
+        return value;
+    }
+    in = emit(IrMove, t->lineno);
+    in->dst = operand(IrVar, locationOf(b));
+    in->a = value;
+    return in->dst;
+}
+
+/* Function opcodeOf returns the instruction of the
+ * operator token op
+ */
+static IrOpcode opcodeOf(TokenType op)
+{
+    switch (op)
+    {
+        case PLUS:
+            return IrAdd;
+        case MINUS:
+            return IrSub;
+        case TIMES:
+            return IrMul;
+        case OVER:
+            return IrDiv;
+        case LT:
+            return IrLt;
+        case LE:
+            return IrLe;
+        case GT:
+            return IrGt;
+        case GE:
+            return IrGe;
+        case EQ:
+            return IrEq;
+        default:
+            return IrNe;
+    }
+}
+
+static IrOperand lowerCall(TreeNode* t)
+{
+    BucketList b = symbolOf(t);
+    TreeNode* arg;
+    IrInstr in;
+    int i = 0;
+    if (strcmp(t->attr.name, "input") == 0)
+    {
+        in = emit(IrInput, t->lineno);
+        in->dst = newTemp();
+        return in->dst;
+    }
+    if (strcmp(t->attr.name, "output") == 0)
+    {
+        IrOperand value = lowerExp(t->child[0]);
+        emit(IrOutput, t->lineno)->a = value;
+        return operand(IrConst, 0);
+    }
+    in = ir_new_instr(IrCall, t->lineno);
+    in->callee = callees[locationOf(b)];
+    for (arg = t->child[0]; arg != NULL; arg = arg->sibling)
+        ++in->argCount;
+    in->args = (IrOperand*)allocOrDie((in->argCount + 1) * sizeof(IrOperand));
+    for (arg = t->child[0]; arg != NULL; arg = arg->sibling, ++i)
+        in->args[i] = pin(lowerExp(arg), arg->sibling, arg->lineno);
+    ir_insert_before(current, NULL, in);
+    if (!in->callee->returnsValue)
+        return operand(IrConst, 0);
+    in->dst = newTemp();
+    return in->dst;
+}
+
+/* Function lowerExp lowers the expression t and
+ * returns the operand holding its value
+ */
+static IrOperand lowerExp(TreeNode* t)
+{
+    IrOperand a, b;
+    int offset;
+    switch (t->kind.exp)
+    {
+        case ConstantK:
+            return operand(IrConst, t->attr.val);
+
+        case VarK:
+            if (t->child[0] == NULL)
+                return lowerVar(t);
+            a = element(symbolOf(t), t->child[0], &offset);
+            return emitLoad(a, offset, t->lineno);
+
+        case AssignmentK:
+            return lowerAssign(t);
+
+        case OperatorK:
+            a = pin(lowerExp(t->child[0]), t->child[1], t->lineno);
+            b = lowerExp(t->child[1]);
+            return emitOp(opcodeOf(t->attr.op), a, b, t->lineno);
+
+        case CallK:
+            return lowerCall(t);
+
+        default:
+            return operand(IrConst, 0);
+    }
+}
+
+/* Procedure lowerCondition lowers the test t of an
+ * if or a while to a branch to ifTrue or ifFalse
+ */
+static void lowerCondition(TreeNode* t, IrBlock ifTrue, IrBlock ifFalse)
+{
+    IrInstr in;
+    IrOperand a, b;
+    IrOpcode op = IrNe;
+    if (t->kind.exp == OperatorK && (op = opcodeOf(t->attr.op)) >= IrLt)
+    {
+        a = pin(lowerExp(t->child[0]), t->child[1], t->lineno);
+        b = lowerExp(t->child[1]);
+    }
+    else
+    {
+        op = IrNe;
+        a = lowerExp(t);
+        b = operand(IrConst, 0);
+    }
+    in = emit(IrBranch, t->lineno);
+    in->relation = op;
+    in->a = a;
+    in->b = b;
+    ir_order_operands(in);
+    current->succ[0] = ifTrue;
+    current->succ[1] = ifFalse;
+    current->succCount = 2;
+}
+
+/* Procedure declare gives the local declared by t
+ * in the current scope its variable or its slots
+ */
+static void declare(TreeNode* t)
+{
+    BucketList b = st_lookup_excluding_parent(scope, t->attr.name);
+    int size;
+    if (!t->isarray || t->kind.declaration == ParameterK)
+    {
+        setLocation(b, newVariable(t->attr.name));
+        return;
+    }
+    size = t->child[0]->attr.val;
+    arrayTop -= size;
+    setLocation(b, arrayTop + 1);
+    if (paramEnd - arrayTop > function->frameSize)
+        function->frameSize = paramEnd - arrayTop;
+}
+
+/* Function isTailCall tells whether the returned
+ * expression t calls the function being lowered,
+ * so that the call may reuse its frame. Passing a
+ * local array would make the callee's copy of the
+ * array the one it was passed
+ */
+static int isTailCall(TreeNode* t)
+{
+    TreeNode* arg;
+    BucketList b;
+    if (t == NULL || t->nodekind != ExpK || t->kind.exp != CallK)
+        return FALSE;
+    b = symbolOf(t);
+    if (b == NULL || b->kind != FuncSymbol || callees[locationOf(b)] != function)
+        return FALSE;
+    for (arg = t->child[0]; arg != NULL; arg = arg->sibling)
+    {
+        if (arg->kind.exp != VarK || arg->child[0] != NULL)
+            continue;
+        b = symbolOf(arg);
+        if (b->isarray && !isGlobal(b) && !isVariable(b))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/* Function loopHeader returns header, splitting it
+ * off the entry on the first tail call, at line
+ */
+static IrBlock loopHeader(int line)
+{
+    IrBlock entry = function->blocks[0];
+    IrInstr in;
+    int s;
+    if (header != NULL)
+        return header;
+    header = ir_new_block(0);
+    ir_place_block(function, header, 1);
+    for (in = entry->first; in != NULL && in->op == IrParam; in = in->next)
+        ;
+    if (in != NULL)
+    {
+        header->first = in;
+        header->last = entry->last;
+        entry->last = in->prev;
+        if (in->prev != NULL)
+            in->prev->next = NULL;
+        else
+            entry->first = NULL;
+        in->prev = NULL;
+    }
+    for (s = 0; s < entry->succCount; ++s)
+        header->succ[s] = entry->succ[s];
+    header->succCount = entry->succCount;
+    if (current == entry)
+        current = header;
+    ir_insert_before(entry, NULL, ir_new_instr(IrJump, line));
+    entry->succ[0] = header;
+    entry->succCount = 1;
+    return header;
+}
+
+/* Procedure lowerTailCall lowers the tail call t
+ * to assignments of the parameters and a jump to
+ * header. The arguments are all evaluated first,
+ * as they may read the parameters
+ */
+static void lowerTailCall(TreeNode* t)
+{
+    IrOperand* args;
+    TreeNode* arg;
+    IrInstr in;
+    int i = 0, count = 0;
+    for (arg = t->child[0]; arg != NULL; arg = arg->sibling)
+        ++count;
+    args = (IrOperand*)allocOrDie((count + 1) * sizeof(IrOperand));
+    for (arg = t->child[0]; arg != NULL; arg = arg->sibling, ++i)
+    {
+        args[i] = lowerExp(arg);
+        if (args[i].kind == IrVar)
+        {
+            in = emit(IrMove, arg->lineno);
+            in->dst = newTemp();
+            in->a = args[i];
+            args[i] = in->dst;
+        }
+    }
+    /* the parameters are the first variables */
+    for (i = 0; i < count; ++i)
+    {
+        in = emit(IrMove, t->lineno);
+        in->dst = operand(IrVar, i);
+        in->a = args[i];
+    }
+    free(args);
+    emitJump(loopHeader(t->lineno), t->lineno);
+}
+
+static void lowerStmt(TreeNode* t);
+
+static void lowerStmts(TreeNode* t)
+{
+    for (; t != NULL; t = t->sibling)
+        lowerStmt(t);
+}
+
+static void lowerStmt(TreeNode* t)
+{
+    IrBlock thenBlock, elseBlock, join, body, test;
+    IrInstr in;
+    ScopeList savedScope;
+    TreeNode* p;
+    int savedTop;
+    if (t->nodekind == ExpK)
+    {
+        lowerExp(t);
+        return;
+    }
+    if (t->nodekind != StmtK)
+        return;
+    switch (t->kind.stmt)
+    {
+        case CompoundK:
+            savedScope = scope;
+            savedTop = arrayTop;
+            if (t->scope != NULL)
+                scope = t->scope;
+            for (p = t->child[0]; p != NULL; p = p->sibling)
+                declare(p);
+            lowerStmts(t->child[1]);
+            /* sibling blocks reuse the slots */
+            arrayTop = savedTop;
+            scope = savedScope;
+            break;
+
+        case SelectionK:
+            thenBlock = ir_new_block(depth);
+            join = ir_new_block(depth);
+            elseBlock = t->child[2] != NULL ? ir_new_block(depth) : join;
+            lowerCondition(t->child[0], thenBlock, elseBlock);
+            place(thenBlock);
+            lowerStmts(t->child[1]);
+            emitJump(join, t->lineno);
+            if (t->child[2] != NULL)
+            {
+                place(elseBlock);
+                lowerStmts(t->child[2]);
+                emitJump(join, t->lineno);
+            }
+            place(join);
+            break;
+
+        case IterationK:
+            /* the test is placed after the body, so an
+             * iteration takes a single branch
+             */
+            body = ir_new_block(depth + 1);
+            test = ir_new_block(depth + 1);
+            join = ir_new_block(depth);
+            emitJump(test, t->lineno);
+            ++depth;
+            place(body);
+            lowerStmts(t->child[1]);
+            emitJump(test, t->lineno);
+            place(test);
+            lowerCondition(t->child[0], body, join);
+            --depth;
+            place(join);
+            break;
+
+        case ReturnK:
+            if (isTailCall(t->child[0]))
+            {
+                lowerTailCall(t->child[0]);
+                place(ir_new_block(depth));
+                break;
+            }
+            in = ir_new_instr(IrReturn, t->lineno);
+            if (t->child[0] != NULL)
+                in->a = lowerExp(t->child[0]);
+            ir_insert_before(current, NULL, in);
+            /* the code after a return is not reached */
+            place(ir_new_block(depth));
+            break;
+
+        default:
+            break;
+    }
+}
+
+static int isTerminator(IrInstr in)
+{
+    return in != NULL && (in->op == IrJump || in->op == IrBranch || in->op == IrReturn);
+}
+
+/* Procedure markTailLoop adds one to the loop depth
+ * of the blocks in the loop the tail calls of f
+ * close: header and the blocks that reach a jump
+ * back to it without passing it
+ */
+static void markTailLoop(IrFunction f)
+{
+    IrBlock* stack = (IrBlock*)allocOrDie((f->blockCount + 1) * sizeof(IrBlock));
+    char* inLoop = (char*)allocOrDie(f->blockCount + 1);
+    int top = 0, i, p;
+    inLoop[header->id] = TRUE;
+    for (p = 0; p < header->predCount; ++p)
+        if (header->pred[p] != f->blocks[0] && !inLoop[header->pred[p]->id])
+        {
+            inLoop[header->pred[p]->id] = TRUE;
+            stack[top++] = header->pred[p];
+        }
+    while (top > 0)
+    {
+        IrBlock b = stack[--top];
+        for (p = 0; p < b->predCount; ++p)
+            if (!inLoop[b->pred[p]->id])
+            {
+                inLoop[b->pred[p]->id] = TRUE;
+                stack[top++] = b->pred[p];
+            }
+    }
+    for (i = 0; i < f->blockCount; ++i)
+        if (inLoop[i])
+            ++f->blocks[i]->depth;
+    free(stack);
+    free(inLoop);
+}
+
+/* Procedure lowerFunction lowers the function
+ * declared by t to f
+ */
+static void lowerFunction(TreeNode* t, IrFunction f)
+{
+    TreeNode* p;
+    IrInstr in;
+    int i;
+    function = f;
+    scope = t->scope;
+    header = NULL;
+    depth = 0;
+    place(ir_new_block(0));
+    for (p = t->child[0]; p != NULL; p = p->sibling)
+    {
+        if (p->kind.declaration != ParameterK)
+            continue;
+        declare(p);
+        in = emit(IrParam, p->lineno);
+        in->dst = operand(IrVar, function->varCount - 1);
+        in->offset = f->paramCount++;
+    }
+    paramEnd = arrayTop = -2 - f->paramCount;
+    lowerStmt(t->child[1]);
+    if (!isTerminator(current->last))
+        emit(IrReturn, t->lineno);
+    for (i = 0; i < f->blockCount; ++i)
+    {
+        IrBlock b = f->blocks[i];
+        int s;
+        for (s = 0; s < b->succCount; ++s)
+            ir_add_pred(b->succ[s], b);
+    }
+    if (header != NULL)
+        markTailLoop(f);
+    scope = symtab->global;
+}
+
+IrProgram ir_lower(TreeNode* syntaxTree, Symtab tab)
+{
+    IrProgram program;
+    IrFunction f, last = NULL;
+    BucketList mainFunction;
+    TreeNode* t;
+    int count = 0;
+    mainFunction = st_lookup_excluding_parent(tab->global, "main");
+    if (mainFunction == NULL || mainFunction->kind != FuncSymbol)
+    {
+        fprintf(listing, "Code generation error: function main is not declared\n");
+        Error = TRUE;
+        return NULL;
+    }
+    symtab = tab;
+    scope = tab->global;
+    program = (IrProgram)allocOrDie(sizeof(*program));
+    for (t = syntaxTree; t != NULL; t = t->sibling)
+        if (t->nodekind == DeclarationK && t->kind.declaration == FuncK)
+            ++count;
+    callees = (IrFunction*)allocOrDie((count + 1) * sizeof(IrFunction));
+    locationMask = 63;
+    locations = (Location*)allocOrDie((locationMask + 1) * sizeof(Location));
+    locationCount = 0;
+    count = 0;
+    for (t = syntaxTree; t != NULL; t = t->sibling)
+    {
+        BucketList b;
+        if (t->nodekind != DeclarationK)
+            continue;
+        b = st_lookup_excluding_parent(tab->global, t->attr.name);
+        if (t->kind.declaration != FuncK)
+        {
+            setLocation(b, program->globalSize);
+            program->globalSize += t->isarray ? t->child[0]->attr.val : 1;
+            continue;
+        }
+        f = (IrFunction)allocOrDie(sizeof(struct IrFunctionRec));
+        f->name = t->attr.name;
+        f->returnsValue = b->type != Void;
+        if (b == mainFunction)
+            program->main = f;
+        if (last == NULL)
+            program->functions = f;
+        else
+            last->next = f;
+        last = f;
+        setLocation(b, count);
+        callees[count++] = f;
+    }
+    for (t = syntaxTree, f = program->functions; t != NULL; t = t->sibling)
+    {
+        if (t->nodekind == DeclarationK && t->kind.declaration == FuncK)
+        {
+            lowerFunction(t, f);
+            f = f->next;
+        }
+    }
+    free(callees);
+    callees = NULL;
+    free(locations);
+    locations = NULL;
+    return program;
+}
+
+/************************************************/
+/* printing                                     */
+/************************************************/
+
+static const char* opNames[] = { "move",  "+",      "-",     "*",     "/",     "<",   "<=",
+                                 ">",     ">=",     "==",    "!=",    "load",  "store", "param",
+                                 "call",  "input",  "output", "phi",  "goto",  "if",  "return" };
+
+static void printOperand(FILE* out, IrFunction f, IrOperand o)
+{
+    switch (o.kind)
+    {
+        case IrTemp:
+            fprintf(out, "t%d", o.value);
+            break;
+        case IrVar:
+            fprintf(out, "%s", f->varNames[o.value]);
+            break;
+        case IrConst:
+            fprintf(out, "%d", o.value);
+            break;
+        case IrFrame:
+            fprintf(out, "fp");
+            break;
+        default:
+            fprintf(out, "_");
+            break;
+    }
+}
+
+static void printAddress(FILE* out, IrFunction f, IrOperand base, int offset)
+{
+    fprintf(out, "[");
+    printOperand(out, f, base);
+    if (offset != 0)
+        fprintf(out, "%+d", offset);
+    fprintf(out, "]");
+}
+
+static void printInstr(FILE* out, IrFunction f, IrBlock b, IrInstr in)
+{
+    int i;
+    fprintf(out, "    ");
+    if (in->dst.kind != IrNone)
+    {
+        printOperand(out, f, in->dst);
+        fprintf(out, " = ");
+    }
+    switch (in->op)
+    {
+        case IrMove:
+            printOperand(out, f, in->a);
+            break;
+        case IrLoad:
+            printAddress(out, f, in->a, in->offset);
+            break;
+        case IrStore:
+            printAddress(out, f, in->b, in->offset);
+            fprintf(out, " = ");
+            printOperand(out, f, in->a);
+            break;
+        case IrParam:
+            fprintf(out, "param %d", in->offset);
+            break;
+        case IrCall:
+        case IrPhi:
+            fprintf(out, "%s(", in->op == IrCall ? in->callee->name : "phi");
+            for (i = 0; i < in->argCount; ++i)
+            {
+                if (i > 0)
+                    fprintf(out, ", ");
+                printOperand(out, f, in->args[i]);
+            }
+            fprintf(out, ")");
+            break;
+        case IrInput:
+            fprintf(out, "input");
+            break;
+        case IrOutput:
+        case IrReturn:
+            fprintf(out, "%s", opNames[in->op]);
+            if (in->a.kind != IrNone)
+            {
+                fprintf(out, " ");
+                printOperand(out, f, in->a);
+            }
+            break;
+        case IrJump:
+            fprintf(out, "goto B%d", b->succ[0]->id);
+            break;
+        case IrBranch:
+            fprintf(out, "if ");
+            printOperand(out, f, in->a);
+            fprintf(out, " %s ", opNames[in->relation]);
+            printOperand(out, f, in->b);
+            fprintf(out, " goto B%d else B%d", b->succ[0]->id, b->succ[1]->id);
+            break;
+        default:
+            printOperand(out, f, in->a);
+            fprintf(out, " %s ", opNames[in->op]);
+            printOperand(out, f, in->b);
+            break;
+    }
+    fprintf(out, "\n");
+}
+
+void ir_print(FILE* out, IrProgram program)
+{
+    IrFunction f;
+    IrBlock b;
+    IrInstr in;
+    int i, p;
+    fprintf(out, "\nIntermediate code: %d global locations\n", program->globalSize);
+    for (f = program->functions; f != NULL; f = f->next)
+    {
+        fprintf(out, "\nfunction %s: %d parameters, %d temps, %d array slots\n", f->name, f->paramCount,
+                f->tempCount, f->frameSize);
+        for (i = 0; i < f->blockCount; ++i)
+        {
+            b = f->blocks[i];
+            fprintf(out, "B%d:", b->id);
+            if (b->predCount > 0)
+            {
+                fprintf(out, " from");
+                for (p = 0; p < b->predCount; ++p)
+                    fprintf(out, " B%d", b->pred[p]->id);
+            }
+            if (b->depth > 0)
+                fprintf(out, ", loop depth %d", b->depth);
+            fprintf(out, "\n");
+            for (in = b->first; in != NULL; in = in->next)
+                printInstr(out, f, b, in);
+        }
+    }
+}
+
+void ir_free(IrProgram program)
+{
+    IrFunction f, next;
+    IrInstr in, nextIn;
+    int i;
+    if (program == NULL)
+        return;
+    for (f = program->functions; f != NULL; f = next)
+    {
+        next = f->next;
+        for (i = 0; i < f->blockCount; ++i)
+        {
+            for (in = f->blocks[i]->first; in != NULL; in = nextIn)
+            {
+                nextIn = in->next;
+                free(in->args);
+                free(in);
+            }
+            free(f->blocks[i]->pred);
+            free(f->blocks[i]);
+        }
+        free(f->blocks);
+        free(f->varNames);
+        free(f);
+    }
+    free(program);
+}
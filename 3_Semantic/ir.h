@@ -0,0 +1,210 @@
+/****************************************************/
+/* File: ir.h                                       */
+/* The intermediate representation of the C-Minus   */
+/* compiler: control-flow graphs of three-address   */
+/* instructions over virtual registers              */
+/****************************************************/
+
+#ifndef _IR_H_
+#define _IR_H_
+
+#include "globals.h"
+#include "symtab.h"
+
+/* The syntax tree of every function is lowered to
+ * a control-flow graph of basic blocks. A block is
+ * a list of instructions ending with a jump, a
+ * branch or a return. Instructions compute into
+ * virtual registers ("temps"), of which a function
+ * has any number.
+ *
+ * Scalar locals and parameters are variables while
+ * the tree is lowered, and may be assigned many
+ * times. ir_to_ssa renames them into temps that
+ * are each assigned once, with phi instructions
+ * where control flow merges; ir_from_ssa replaces
+ * the phis by moves, after which a temp may again
+ * be assigned in several places. Globals and
+ * arrays live in memory, reached by loads and
+ * stores
+ */
+
+/* an operand of an instruction */
+typedef enum
+{
+    IrNone,  /* no operand */
+    IrTemp,  /* the temp numbered value */
+    IrVar,   /* the variable numbered value, before SSA */
+    IrConst, /* the integer value */
+    IrFrame  /* the frame pointer of the function */
+} IrOperandKind;
+
+typedef struct
+{
+    IrOperandKind kind;
+    int value;
+} IrOperand;
+
+typedef enum
+{
+    IrMove,   /* dst = a */
+    IrAdd,    /* dst = a + b */
+    IrSub,    /* dst = a - b */
+    IrMul,    /* dst = a * b */
+    IrDiv,    /* dst = a / b */
+    IrLt,     /* dst = a < b, 1 or 0 */
+    IrLe,     /* dst = a <= b */
+    IrGt,     /* dst = a > b */
+    IrGe,     /* dst = a >= b */
+    IrEq,     /* dst = a == b */
+    IrNe,     /* dst = a != b */
+    IrLoad,   /* dst = mem[a + offset] */
+    IrStore,  /* mem[b + offset] = a */
+    IrParam,  /* dst = parameter number offset */
+    IrCall,   /* dst = callee(args) */
+    IrInput,  /* dst = input() */
+    IrOutput, /* output(a) */
+    IrPhi,    /* dst = args[i] coming from pred[i] */
+    IrJump,   /* goto succ[0] */
+    IrBranch, /* if a relation b goto succ[0] else succ[1] */
+    IrReturn  /* return a, or nothing if a is IrNone */
+} IrOpcode;
+
+/* the address a + offset of a load or a store is
+ * absolute when a is a constant, relative to the
+ * frame pointer when a is IrFrame, and relative to
+ * the address in a otherwise
+ */
+typedef struct IrInstrRec
+{
+    IrOpcode op;
+    IrOperand dst; /* IrTemp, IrVar or IrNone */
+    IrOperand a, b;
+    int offset;
+    IrOpcode relation; /* of an IrBranch: IrLt..IrNe */
+    struct IrFunctionRec* callee;
+    IrOperand* args; /* of an IrCall or an IrPhi */
+    int argCount;
+    int saves; /* of an IrCall: registers live across it */
+    int lineno;
+    struct IrInstrRec* prev;
+    struct IrInstrRec* next;
+}* IrInstr;
+
+typedef struct IrBlockRec
+{
+    int id;
+    int depth; /* number of loops around the block */
+    IrInstr first;
+    IrInstr last;
+    struct IrBlockRec* succ[2];
+    int succCount;
+    struct IrBlockRec** pred;
+    int predCount;
+    int predCapacity;
+    /* the dominator tree, set by ir_to_ssa */
+    struct IrBlockRec* idom;
+    int order; /* in reverse postorder */
+}* IrBlock;
+
+typedef struct IrFunctionRec
+{
+    char* name;
+    int paramCount;
+    int returnsValue;
+    /* blocks[0] is the entry; the order of blocks
+     * is the order their code is laid out in
+     */
+    IrBlock* blocks;
+    int blockCount;
+    int blockCapacity;
+    int tempCount;
+    char** varNames; /* by variable number */
+    int varCount;
+    int varCapacity;
+    /* the local arrays take frameSize slots, from
+     * offset -1-paramCount down
+     */
+    int frameSize;
+    int label; /* of the entry, given by the code generator */
+    struct IrFunctionRec* next;
+}* IrFunction;
+
+typedef struct
+{
+    IrFunction functions; /* in the order of the source */
+    IrFunction main;
+    int globalSize; /* globals take locations 0..globalSize-1 */
+}* IrProgram;
+
+/* Function ir_lower lowers the checked syntax tree,
+ * whose names are resolved in tab, to variables
+ * and temps. It returns NULL and sets Error if the
+ * program cannot run: main is not declared
+ */
+IrProgram ir_lower(TreeNode* syntaxTree, Symtab tab);
+
+/* Procedure ir_to_ssa puts every function of
+ * program in SSA form, propagates its constants
+ * and copies, and removes the blocks that cannot
+ * be reached and the instructions whose results
+ * are not used
+ */
+void ir_to_ssa(IrProgram program);
+
+/* Procedure ir_from_ssa replaces the phis of every
+ * function of program by moves on the edges into
+ * their blocks, splitting the edges that need it
+ */
+void ir_from_ssa(IrProgram program);
+
+/* Function ir_new_temp returns a new temp of f */
+int ir_new_temp(IrFunction f);
+
+/* Function ir_new_instr returns a new instruction
+ * with no operands, in no block
+ */
+IrInstr ir_new_instr(IrOpcode op, int lineno);
+
+/* Procedure ir_insert_before inserts in into block
+ * b before the instruction before, or at the end of
+ * b if before is NULL
+ */
+void ir_insert_before(IrBlock b, IrInstr before, IrInstr in);
+
+/* Procedure ir_remove unlinks in from block b and
+ * frees it
+ */
+void ir_remove(IrBlock b, IrInstr in);
+
+/* Function ir_new_block returns a new block at
+ * loop depth depth, in no function
+ */
+IrBlock ir_new_block(int depth);
+
+/* Procedure ir_place_block places b in f at index
+ * in the order of its blocks, and numbers the
+ * blocks of f by that order
+ */
+void ir_place_block(IrFunction f, IrBlock b, int index);
+
+/* Procedure ir_add_pred makes p a predecessor of b */
+void ir_add_pred(IrBlock b, IrBlock p);
+
+/* Procedure ir_order_operands puts a constant
+ * operand of in second, if its operation allows
+ */
+void ir_order_operands(IrInstr in);
+
+/* Function ir_is_pure tells whether in may be
+ * removed when its result is not used
+ */
+int ir_is_pure(IrInstr in);
+
+/* Procedure ir_print writes program to out */
+void ir_print(FILE* out, IrProgram program);
+
+/* Procedure ir_free frees program */
+void ir_free(IrProgram program);
+
+#endif
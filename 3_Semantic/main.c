@@ -6,29 +6,19 @@
 /****************************************************/
 
 #include "globals.h"
-
-/* set NO_PARSE to TRUE to get a scanner-only compiler */
-#define NO_PARSE FALSE
-/* set NO_ANALYZE to TRUE to get a parser-only compiler */
-#define NO_ANALYZE FALSE
-
-/* set NO_CODE to TRUE to get a compiler that does not
- * generate code
- */
-#define NO_CODE TRUE
-
 #include "util.h"
-#if NO_PARSE
-    #include "scan.h"
-#else
-    #include "parse.h"
-    #if !NO_ANALYZE
-        #include "analyze.h"
-        #if !NO_CODE
-            #include "cgen.h"
-        #endif
-    #endif
-#endif
+#include "scan.h"
+#include "parse.h"
+#include "analyze.h"
+#include "parallel.h"
+#include "callgraph.h"
+#include "phase.h"
+#include "memtrack.h"
+#include "events.h"
+#include "fold.h"
+#include "ir.h"
+#include "cgen.h"
+#include "peephole.h"
 
 /* allocate global variables */
 int lineno = 0;
@@ -36,77 +26,455 @@ FILE* source;
 FILE* listing;
 FILE* code;
 
-/* allocate and set tracing flags */
+/* allocate tracing flags; they are set by --trace */
 int EchoSource = FALSE;
 int TraceScan = FALSE;
 int TraceParse = FALSE;
 int TraceAnalyze = FALSE;
+int TraceIr = FALSE;
 int TraceCode = FALSE;
 
 int Error = FALSE;
 
-int main(int argc, char* argv[])
+/* the passes of the compiler in pipeline order.
+ * The parser pulls its tokens from the scanner, so
+ * the scan pass runs on its own only when the
+ * pipeline stops after it
+ */
+typedef enum
+{
+    ScanPass,
+    ParsePass,
+    AnalyzePass,
+    IrPass,
+    CodegenPass,
+    PassCount
+} PassKind;
+
+typedef struct
 {
-    TreeNode* syntaxTree;
-    char pgm[120]; /* source code file name */
-    if (argc != 2)
+    const char* name;
+    int* trace;         /* tracing flag of the pass */
+    void (*run)(void);
+} Pass;
+
+/* stopAfter is the last pass that is run. It is
+ * analysis by default, so that checking a program,
+ * as the semantic tests do, writes no code file
+ */
+static PassKind stopAfter = AnalyzePass;
+
+/* timePasses selects the report of time, heap
+ * growth and counts per phase written to stderr:
+ * 0 = none, 1 = text, 2 = JSON
+ */
+static int timePasses = 0;
+
+/* memReport selects the report of allocations by
+ * kind and phase written to stderr: 0 = none,
+ * 1 = text, 2 = JSON
+ */
+static int memReport = 0;
+
+/* traceOut names the file of Chrome trace events
+ * for the passes, functions and threads, or is NULL
+ */
+static char* traceOut = NULL;
+
+/* symtabStats selects the symbol table statistics
+ * report written to stderr: 0 = none, 1 = text, 2 = JSON
+ */
+static int symtabStats = 0;
+
+/* singlePass selects the analyzer that builds the
+ * symbol table and checks types in one traversal
+ */
+static int singlePass = FALSE;
+
+/* jobs is the number of type checking threads;
+ * 0 means one per processor
+ */
+static int jobs = 0;
+
+/* stream selects the streaming mode: every top-level
+ * declaration is analyzed and freed as soon as it
+ * is parsed, so memory stays bounded by the largest
+ * function
+ */
+static int stream = FALSE;
+
+/* callGraph selects the call graph report written
+ * to stderr: 0 = none, 1 = text, 2 = DOT
+ */
+static int callGraph = 0;
+
+/* binary selects the .tmb object format for the
+ * code file instead of TM text
+ */
+static int binary = FALSE;
+
+/* peepholeStats prints the hits of each peephole
+ * rule to stderr after code generation
+ */
+static int peepholeStats = FALSE;
+
+/* pgm is the source code file name */
+static char pgm[120];
+
+/* the program as it moves through the passes */
+static TreeNode* syntaxTree = NULL;
+static Symtab symtab = NULL;
+static CallGraph callgraph = NULL;
+static IrProgram program = NULL;
+
+/* streamSymtab keeps the globals in streaming mode */
+static Symtab streamSymtab;
+
+static void scanPass(void)
+{
+    TokenType token;
+    ph_push(ScanPhase);
+    while ((token = getToken()) != ENDFILE)
+        if (token == ERROR)
+        {
+            fprintf(listing, "Lexical error at line %d: ", lineno);
+            printToken(token, tokenString);
+            Error = TRUE;
+        }
+    ph_pop();
+}
+
+/* Procedure compileDeclaration is called by the
+ * parser in streaming mode for every top-level
+ * declaration; it is analyzed only if the pipeline
+ * goes on to analysis
+ */
+static void compileDeclaration(TreeNode* t)
+{
+    ph_count_tree(t);
+    if (TraceParse)
     {
-        fprintf(stderr, "usage: %s <filename>\n", argv[0]);
-        exit(1);
+        ph_push(OutputPhase);
+        printTree(t);
+        ph_pop();
     }
-    strcpy(pgm, argv[1]);
-    if (strchr(pgm, '.') == NULL)
-        strcat(pgm, ".tny");
-    source = fopen(pgm, "r");
-    if (source == NULL)
+    if (stopAfter < AnalyzePass)
     {
-        fprintf(stderr, "File %s not found\n", pgm);
-        exit(1);
+        releaseDeclaration(t);
+        return;
     }
-    listing = stdout; /* send listing to screen */
-    fprintf(listing, "\nC-MINUS COMPILATION: %s\n", pgm);
-#if NO_PARSE
-    while (getToken() != ENDFILE)
-        ;
-#else
+    /* the declaration is freed as part of its
+     * analysis, or by analyzeEnd if it is held
+     */
+    ph_push(AnalyzePhase);
+    if (analyzeDeclaration(streamSymtab, t))
+        releaseDeclaration(t);
+    ph_pop();
+}
+
+/* In streaming mode the parse pass also does the
+ * analysis, declaration by declaration, and leaves
+ * the analyze pass nothing to do
+ */
+static void parsePass(void)
+{
+    if (stream)
+    {
+        if (TraceParse)
+            fprintf(listing, "\nSyntax tree:\n");
+        if (stopAfter >= AnalyzePass)
+        {
+            st_set_stats(symtabStats != 0);
+            if (TraceAnalyze)
+                fprintf(listing, "\nAnalyzing...\n");
+            streamSymtab = analyzeBegin();
+        }
+        ph_push(ParsePhase);
+        parseDeclarations(compileDeclaration);
+        ph_pop();
+        if (stopAfter < AnalyzePass)
+            return;
+        ph_push(OutputPhase);
+        if (TraceAnalyze)
+        {
+            printSymTab(listing, streamSymtab);
+            printFuncTab(listing, streamSymtab);
+        }
+        ph_pop();
+        ph_push(AnalyzePhase);
+        analyzeEnd(streamSymtab);
+        ph_pop();
+        ph_push(OutputPhase);
+        if (TraceAnalyze)
+            fprintf(listing, "\nType Checking Finished\n");
+        if (symtabStats)
+            printSymtabStats(stderr, streamSymtab, symtabStats == 2);
+        ph_pop();
+        return;
+    }
+    ph_push(ParsePhase);
     syntaxTree = parse();
+    ph_pop();
+    ph_count_tree(syntaxTree);
     if (TraceParse)
     {
+        ph_push(OutputPhase);
         fprintf(listing, "\nSyntax tree:\n");
         printTree(syntaxTree);
+        ph_pop();
+    }
+}
+
+static void analyzePass(void)
+{
+    if (stream)
+        return;
+    st_set_stats(symtabStats != 0);
+    setCheckThreads(jobs ? jobs : parallel_threads());
+    if (singlePass)
+    {
+        if (TraceAnalyze)
+            fprintf(listing, "\nAnalyzing...\n");
+        ph_push(AnalyzePhase);
+        symtab = analyze(syntaxTree, NULL);
+        ph_pop();
     }
-    #if !NO_ANALYZE
-    if (!Error)
+    else
     {
         if (TraceAnalyze)
             fprintf(listing, "\nBuilding Symbol Table...\n");
-        buildSymtab(syntaxTree);
+        ph_push(BuildPhase);
+        symtab = buildSymtab(syntaxTree, NULL);
+        ph_pop();
         if (TraceAnalyze)
             fprintf(listing, "\nChecking Types...\n");
-        typeCheck(syntaxTree);
-        if (TraceAnalyze)
-            fprintf(listing, "\nType Checking Finished\n");
+        ph_push(CheckPhase);
+        typeCheck(syntaxTree, symtab);
+        ph_pop();
+    }
+    if (TraceAnalyze)
+        fprintf(listing, "\nType Checking Finished\n");
+    if (symtabStats)
+    {
+        ph_push(OutputPhase);
+        printSymtabStats(stderr, symtab, symtabStats == 2);
+        ph_pop();
     }
-        #if !NO_CODE
-    if (!Error)
+    if (!Error && (callGraph || stopAfter >= IrPass))
     {
-        char* codefile;
-        int fnlen = strcspn(pgm, ".");
-        codefile = (char*)calloc(fnlen + 4, sizeof(char));
-        strncpy(codefile, pgm, fnlen);
-        strcat(codefile, ".tm");
-        code = fopen(codefile, "w");
-        if (code == NULL)
+        ph_push(CallGraphPhase);
+        callgraph = cg_build(syntaxTree, symtab);
+        ph_pop();
+        if (callGraph)
         {
-            printf("Unable to open %s\n", codefile);
-            exit(1);
+            ph_push(OutputPhase);
+            cg_print(stderr, callgraph, callGraph == 2);
+            ph_pop();
         }
-        codeGen(syntaxTree, codefile);
+    }
+}
+
+static void irPass(void)
+{
+    ph_push(IrPhase);
+    /* functions main never calls are not lowered */
+    syntaxTree = cg_prune(syntaxTree, callgraph);
+    ph_push(FoldPhase);
+    foldConstants(syntaxTree);
+    ph_pop();
+    program = ir_lower(syntaxTree, symtab);
+    if (program != NULL)
+    {
+        ir_to_ssa(program);
+        if (TraceIr)
+        {
+            ph_push(OutputPhase);
+            ir_print(listing, program);
+            ph_pop();
+        }
+    }
+    ph_pop();
+}
+
+static void codegenPass(void)
+{
+    char codefile[124];
+    char* dot = strrchr(pgm, '.');
+    ph_push(CodegenPhase);
+    /* the code file is the source file with a .tm or
+     * .tmb extension
+     */
+    strcpy(codefile, pgm);
+    if (dot != NULL && strchr(dot, '/') == NULL)
+        codefile[dot - pgm] = '\0';
+    strcat(codefile, binary ? ".tmb" : ".tm");
+    code = fopen(codefile, binary ? "wb" : "w");
+    if (code == NULL)
+    {
+        fprintf(stderr, "Unable to open %s\n", codefile);
+        Error = TRUE;
+    }
+    else
+    {
+        codeGen(program, codefile, binary);
+        if (peepholeStats)
+            pp_print(stderr);
         fclose(code);
+        if (Error)
+            remove(codefile);
+        else
+            fprintf(listing, "\nCode written to %s\n", codefile);
+    }
+    ph_pop();
+}
+
+static Pass passes[PassCount] = {
+    { "scan", &TraceScan, scanPass },
+    { "parse", &TraceParse, parsePass },
+    { "analyze", &TraceAnalyze, analyzePass },
+    { "ir", &TraceIr, irPass },
+    { "codegen", &TraceCode, codegenPass }
+};
+
+/* Function findPass returns the pass named by the
+ * first len characters of name, or -1
+ */
+static int findPass(const char* name, size_t len)
+{
+    int p;
+    for (p = 0; p < PassCount; ++p)
+        if (strlen(passes[p].name) == len && strncmp(passes[p].name, name, len) == 0)
+            return p;
+    return -1;
+}
+
+/* Function setTrace turns on the tracing flags of
+ * the comma-separated passes in list; it returns
+ * FALSE if list names an unknown pass
+ */
+static int setTrace(const char* list)
+{
+    while (*list != '\0')
+    {
+        size_t len = strcspn(list, ",");
+        int p = findPass(list, len);
+        if (p < 0)
+            return FALSE;
+        *passes[p].trace = TRUE;
+        list += len;
+        if (*list == ',')
+            ++list;
+    }
+    return TRUE;
+}
+
+/* Procedure runPasses runs the pipeline up to and
+ * including stopAfter, stopping early at the first
+ * pass that reports an error
+ */
+static void runPasses(void)
+{
+    int p;
+    for (p = stopAfter == ScanPass ? ScanPass : ParsePass; p <= (int)stopAfter && !Error; ++p)
+        passes[p].run();
+}
+
+int main(int argc, char* argv[])
+{
+    char* filename = NULL;
+    int i;
+    for (i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--symtab-stats") == 0)
+            symtabStats = 1;
+        else if (strcmp(argv[i], "--symtab-stats=json") == 0)
+            symtabStats = 2;
+        else if (strcmp(argv[i], "--single-pass") == 0)
+            singlePass = TRUE;
+        else if (strcmp(argv[i], "--callgraph") == 0)
+            callGraph = 1;
+        else if (strcmp(argv[i], "--callgraph=dot") == 0)
+            callGraph = 2;
+        else if (strcmp(argv[i], "--stream") == 0)
+            stream = TRUE;
+        else if (strncmp(argv[i], "--jobs=", 7) == 0 && atoi(argv[i] + 7) > 0)
+            jobs = atoi(argv[i] + 7);
+        else if (strncmp(argv[i], "--stop-after=", 13) == 0 && findPass(argv[i] + 13, strlen(argv[i] + 13)) >= 0)
+            stopAfter = (PassKind)findPass(argv[i] + 13, strlen(argv[i] + 13));
+        else if (strncmp(argv[i], "--trace=", 8) == 0 && setTrace(argv[i] + 8))
+            ;
+        else if (strcmp(argv[i], "--time-passes") == 0)
+            timePasses = 1;
+        else if (strcmp(argv[i], "--time-passes=json") == 0)
+            timePasses = 2;
+        else if (strcmp(argv[i], "--mem-report") == 0)
+            memReport = 1;
+        else if (strcmp(argv[i], "--mem-report=json") == 0)
+            memReport = 2;
+        else if (strcmp(argv[i], "--emit=tm") == 0)
+            binary = FALSE;
+        else if (strcmp(argv[i], "--emit=tmb") == 0)
+            binary = TRUE;
+        else if (strcmp(argv[i], "--no-peephole") == 0)
+            pp_enable(FALSE);
+        else if (strcmp(argv[i], "--peephole-stats") == 0)
+            peepholeStats = TRUE;
+        else if (strncmp(argv[i], "--trace-out=", 12) == 0 && argv[i][12] != '\0')
+            traceOut = argv[i] + 12;
+        else if (argv[i][0] != '-' && filename == NULL)
+            filename = argv[i];
+        else
+            break;
+    }
+    if (filename == NULL || i < argc)
+    {
+        fprintf(stderr, "usage: %s [--stop-after=scan|parse|analyze|ir|codegen] [--trace=PASS,...] [--time-passes[=json]] [--mem-report[=json]] [--trace-out=FILE] [--emit=tm|tmb] [--no-peephole] [--peephole-stats] [--symtab-stats[=json]] [--single-pass] [--jobs=N] [--stream] [--callgraph[=dot]] <filename>\n", argv[0]);
+        exit(1);
+    }
+    /* lowering and code generation need the whole
+     * program, which streaming mode frees as it goes
+     */
+    if (stream && stopAfter >= IrPass)
+    {
+        fprintf(stderr, "%s: --stream cannot be used with --stop-after=%s: streaming mode cannot lower or generate code\n", argv[0], passes[stopAfter].name);
+        exit(1);
+    }
+    strcpy(pgm, filename);
+    if (strchr(pgm, '.') == NULL)
+        strcat(pgm, ".tny");
+    source = fopen(pgm, "r");
+    if (source == NULL)
+    {
+        fprintf(stderr, "File %s not found\n", pgm);
+        exit(1);
+    }
+    if (traceOut != NULL && !ev_open(traceOut))
+    {
+        fprintf(stderr, "Unable to open %s\n", traceOut);
+        exit(1);
+    }
+    listing = stdout; /* send listing to screen */
+    fprintf(listing, "\nC-MINUS COMPILATION: %s\n", pgm);
+    /* --time-passes reports the allocations too */
+    if (memReport || timePasses)
+        mt_enable();
+    if (timePasses)
+        ph_enable();
+    runPasses();
+    if (timePasses)
+    {
+        ph_count_symtab(stream ? streamSymtab : symtab);
+        ph_print(stderr, timePasses == 2);
     }
-        #endif
-    #endif
-#endif
+    ir_free(program);
+    cg_free(callgraph);
+    st_release(symtab);
+    st_release(streamSymtab);
+    freeTree(syntaxTree);
+    /* after the release, what is still live leaks */
+    if (memReport)
+        mt_print(stderr, memReport == 2);
+    ev_close();
     fclose(source);
-    return 0;
+    return Error ? 1 : 0;
 }
@@ -0,0 +1,171 @@
+/****************************************************/
+/* File: mempool.c                                  */
+/* Memory pool implementation                       */
+/* for the C-Minus compiler                         */
+/* Blocks are carved from large chunks; growable    */
+/* buffers use power-of-two size classes with free  */
+/* lists so that regrown buffers are recycled       */
+/****************************************************/
+
+#include "globals.h"
+#include "mempool.h"
+
+/* CHUNKSIZE is the default size of a pool chunk */
+#define CHUNKSIZE 65536
+
+/* ALIGN is the alignment of every block */
+#define ALIGN 16
+
+/* size classes 2^MINCLASS .. 2^(MINCLASS+NCLASSES-1) */
+#define MINCLASS 3
+#define NCLASSES 24
+
+typedef struct ChunkRec
+{
+    struct ChunkRec* next;
+    size_t size;
+    size_t used;
+} * Chunk;
+
+typedef struct FreeBlockRec
+{
+    struct FreeBlockRec* next;
+} * FreeBlock;
+
+struct MemPoolRec
+{
+    Chunk chunks;
+    FreeBlock freeList[NCLASSES];
+};
+
+#define CHUNKHEADER ((sizeof(struct ChunkRec) + ALIGN - 1) & ~(size_t)(ALIGN - 1))
+
+static Chunk newChunk(MemPool pool, size_t size)
+{
+    Chunk c = (Chunk)malloc(CHUNKHEADER + size);
+    if (c == NULL)
+    {
+        fprintf(listing, "Out of memory error at line %d\n", lineno);
+        exit(1);
+    }
+    c->size = size;
+    c->used = 0;
+    c->next = pool->chunks;
+    pool->chunks = c;
+    return c;
+}
+
+MemPool pool_create(void)
+{
+    MemPool pool = (MemPool)malloc(sizeof(struct MemPoolRec));
+    if (pool == NULL)
+    {
+        fprintf(listing, "Out of memory error at line %d\n", lineno);
+        exit(1);
+    }
+    memset(pool, 0, sizeof(struct MemPoolRec));
+    return pool;
+}
+
+void* pool_alloc(MemPool pool, size_t size)
+{
+    Chunk c = pool->chunks;
+    void* p;
+    size = (size + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+    if (size > CHUNKSIZE / 4)
+    {
+        /* large blocks get a chunk of their own, linked
+         * behind the current one so it stays in use
+         */
+        Chunk big = newChunk(pool, size);
+        if (c != NULL)
+        {
+            pool->chunks = c;
+            big->next = c->next;
+            c->next = big;
+        }
+        big->used = size;
+        p = (char*)big + CHUNKHEADER;
+        memset(p, 0, size);
+        return p;
+    }
+    if (c == NULL || c->used + size > c->size)
+    {
+        c = newChunk(pool, CHUNKSIZE);
+    }
+    p = (char*)c + CHUNKHEADER + c->used;
+    c->used += size;
+    memset(p, 0, size);
+    return p;
+}
+
+char* pool_strdup(MemPool pool, const char* s)
+{
+    size_t n;
+    char* t;
+    if (s == NULL)
+        return NULL;
+    n = strlen(s) + 1;
+    t = (char*)pool_alloc(pool, n);
+    memcpy(t, s, n);
+    return t;
+}
+
+/* Function sizeClass returns the smallest class
+ * whose blocks hold size bytes
+ */
+static int sizeClass(int size)
+{
+    int cls = 0;
+    while ((1 << (cls + MINCLASS)) < size)
+        ++cls;
+    return cls;
+}
+
+void* pool_grow(MemPool pool, void* block, int* capacity, int size)
+{
+    int cls;
+    void* p;
+    if (block != NULL && size <= *capacity)
+        return block;
+    cls = sizeClass(size);
+    if (cls >= NCLASSES)
+    {
+        fprintf(listing, "Out of memory error at line %d\n", lineno);
+        exit(1);
+    }
+    if (pool->freeList[cls] != NULL)
+    {
+        p = pool->freeList[cls];
+        pool->freeList[cls] = pool->freeList[cls]->next;
+    }
+    else
+    {
+        p = pool_alloc(pool, (size_t)1 << (cls + MINCLASS));
+    }
+    if (block != NULL)
+    {
+        FreeBlock old = (FreeBlock)block;
+        memcpy(p, block, *capacity);
+        cls = sizeClass(*capacity);
+        old->next = pool->freeList[cls];
+        pool->freeList[cls] = old;
+    }
+    *capacity = 1 << (sizeClass(size) + MINCLASS);
+    return p;
+}
+
+void pool_destroy(MemPool pool)
+{
+    Chunk c;
+    if (pool == NULL)
+        return;
+    c = pool->chunks;
+    while (c != NULL)
+    {
+        Chunk next = c->next;
+        free(c);
+        c = next;
+    }
+    free(pool);
+}
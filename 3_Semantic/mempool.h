@@ -0,0 +1,40 @@
+/****************************************************/
+/* File: mempool.h                                  */
+/* Memory pool interface for the C-Minus compiler   */
+/* (one pool per compilation, released in bulk)     */
+/****************************************************/
+
+#ifndef _MEMPOOL_H_
+#define _MEMPOOL_H_
+
+#include <stddef.h>
+
+typedef struct MemPoolRec* MemPool;
+
+/* Function pool_create creates an empty pool */
+MemPool pool_create(void);
+
+/* Function pool_alloc returns size zeroed bytes
+ * that live until the pool is destroyed
+ */
+void* pool_alloc(MemPool pool, size_t size);
+
+/* Function pool_strdup allocates and makes a new
+ * copy of s inside the pool
+ */
+char* pool_strdup(MemPool pool, const char* s);
+
+/* Function pool_grow resizes a block obtained from
+ * pool_grow (or NULL) from *capacity bytes to at
+ * least size bytes. Block sizes are powers of two;
+ * the old block goes back to its size class free
+ * list for reuse. *capacity is updated
+ */
+void* pool_grow(MemPool pool, void* block, int* capacity, int size);
+
+/* Procedure pool_destroy releases every block of
+ * the pool in O(number of chunks)
+ */
+void pool_destroy(MemPool pool);
+
+#endif
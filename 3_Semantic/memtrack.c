@@ -0,0 +1,198 @@
+/****************************************************/
+/* File: memtrack.c                                 */
+/* Allocation tracking implementation               */
+/* for the C-Minus compiler                         */
+/* Counters are updated atomically, since the type  */
+/* checking threads allocate too                    */
+/****************************************************/
+
+#include <malloc.h>
+#include <sys/resource.h>
+#include "globals.h"
+#include "phase.h"
+#include "memtrack.h"
+
+typedef struct
+{
+    long allocs;
+    long bytes;
+    long live;
+    long peak;
+} KindStats;
+
+typedef struct
+{
+    long allocs;
+    long bytes;
+    long freed;
+} PhaseAllocs;
+
+static const char* kindName[MemKindCount] = {
+    "nodes", "names", "tables", "scopes", "buckets",
+    "symbol names", "line lists", "argument lists", "check results"
+};
+
+static int enabled = FALSE;
+
+static KindStats kinds[MemKindCount];
+static long live, peak;
+
+/* allocations outside any phase are charged to the
+ * extra last entry
+ */
+static PhaseAllocs phases[PhaseCount + 1][MemKindCount];
+
+void mt_enable(void)
+{
+    enabled = TRUE;
+}
+
+static void raiseMax(long* max, long value)
+{
+    long old = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (value > old &&
+           !__atomic_compare_exchange_n(max, &old, value, FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static void countAlloc(MemKind kind, long bytes)
+{
+    PhaseAllocs* p = &phases[ph_current()][kind];
+    __atomic_fetch_add(&kinds[kind].allocs, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&kinds[kind].bytes, bytes, __ATOMIC_RELAXED);
+    raiseMax(&kinds[kind].peak, __atomic_add_fetch(&kinds[kind].live, bytes, __ATOMIC_RELAXED));
+    raiseMax(&peak, __atomic_add_fetch(&live, bytes, __ATOMIC_RELAXED));
+    __atomic_fetch_add(&p->allocs, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&p->bytes, bytes, __ATOMIC_RELAXED);
+}
+
+static void countFree(MemKind kind, long bytes)
+{
+    __atomic_fetch_sub(&kinds[kind].live, bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&live, bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&phases[ph_current()][kind].freed, bytes, __ATOMIC_RELAXED);
+}
+
+void* mt_malloc(size_t size, MemKind kind)
+{
+    void* p = malloc(size);
+    if (enabled && p != NULL)
+        countAlloc(kind, (long)malloc_usable_size(p));
+    return p;
+}
+
+void mt_free(void* p, MemKind kind)
+{
+    if (enabled && p != NULL)
+        countFree(kind, (long)malloc_usable_size(p));
+    free(p);
+}
+
+void mt_pool_add(long owner[MemKindCount], MemKind kind, long bytes)
+{
+    if (!enabled)
+        return;
+    owner[kind] += bytes;
+    countAlloc(kind, bytes);
+}
+
+void mt_pool_release(long owner[MemKindCount])
+{
+    int k;
+    if (!enabled)
+        return;
+    for (k = 0; k < MemKindCount; ++k)
+        if (owner[k])
+            countFree((MemKind)k, owner[k]);
+}
+
+static long peakRss(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss; /* in kilobytes */
+}
+
+static const char* phaseLabel(int p)
+{
+    return p == PhaseCount ? "(none)" : ph_name((Phase)p);
+}
+
+/* Function phaseTotal sums the allocations of phase
+ * p over all kinds; it returns FALSE if there are none
+ */
+static int phaseTotal(int p, PhaseAllocs* total)
+{
+    int k;
+    memset(total, 0, sizeof(*total));
+    for (k = 0; k < MemKindCount; ++k)
+    {
+        total->allocs += phases[p][k].allocs;
+        total->bytes += phases[p][k].bytes;
+        total->freed += phases[p][k].freed;
+    }
+    return total->allocs != 0 || total->freed != 0;
+}
+
+void mt_phase_allocs(int phase, long* allocs, long* bytes)
+{
+    PhaseAllocs total;
+    phaseTotal(phase, &total);
+    *allocs = total.allocs;
+    *bytes = total.bytes;
+}
+
+static void printText(FILE* out)
+{
+    PhaseAllocs total;
+    int k, p;
+    fprintf(out, "\n< Memory Report >\n");
+    fprintf(out, "Kind              Allocs   Bytes (KB)   Live (KB)   Peak (KB)\n");
+    fprintf(out, "--------------   -------   ----------   ---------   ---------\n");
+    for (k = 0; k < MemKindCount; ++k)
+        if (kinds[k].allocs)
+            fprintf(out, "%-14s   %7ld   %10.1f   %9.1f   %9.1f\n", kindName[k], kinds[k].allocs,
+                    kinds[k].bytes / 1024.0, kinds[k].live / 1024.0, kinds[k].peak / 1024.0);
+    fprintf(out, "%-14s   %7s   %10s   %9.1f   %9.1f\n", "total", "", "", live / 1024.0, peak / 1024.0);
+    fprintf(out, "\nPhase             Allocs   Bytes (KB)   Freed (KB)\n");
+    fprintf(out, "--------------   -------   ----------   ----------\n");
+    for (p = 0; p <= PhaseCount; ++p)
+        if (phaseTotal(p, &total))
+            fprintf(out, "%-14s   %7ld   %10.1f   %10.1f\n", phaseLabel(p), total.allocs,
+                    total.bytes / 1024.0, total.freed / 1024.0);
+    fprintf(out, "\nPeak RSS: %ld KB\n", peakRss());
+}
+
+static void printJson(FILE* out)
+{
+    PhaseAllocs total;
+    int k, p, first = TRUE;
+    fprintf(out, "{\n  \"kinds\": [");
+    for (k = 0; k < MemKindCount; ++k)
+        fprintf(out, "%s\n    {\"name\": \"%s\", \"allocs\": %ld, \"bytes\": %ld, \"live\": %ld, \"peak\": %ld}",
+                k ? "," : "", kindName[k], kinds[k].allocs, kinds[k].bytes, kinds[k].live, kinds[k].peak);
+    fprintf(out, "\n  ],\n  \"live\": %ld,\n  \"peak\": %ld,\n  \"phases\": [", live, peak);
+    for (p = 0; p <= PhaseCount; ++p)
+    {
+        if (!phaseTotal(p, &total))
+            continue;
+        fprintf(out, "%s\n    {\"name\": \"%s\", \"allocs\": %ld, \"bytes\": %ld, \"freed\": %ld, \"kinds\": {",
+                first ? "" : ",", phaseLabel(p), total.allocs, total.bytes, total.freed);
+        for (k = 0; k < MemKindCount; ++k)
+            fprintf(out, "%s\"%s\": {\"allocs\": %ld, \"bytes\": %ld, \"freed\": %ld}", k ? ", " : "",
+                    kindName[k], phases[p][k].allocs, phases[p][k].bytes, phases[p][k].freed);
+        fprintf(out, "}}");
+        first = FALSE;
+    }
+    fprintf(out, "\n  ],\n  \"peak_rss_kb\": %ld\n}\n", peakRss());
+}
+
+void mt_print(FILE* out, int json)
+{
+    if (!enabled)
+        return;
+    if (json)
+        printJson(out);
+    else
+        printText(out);
+}
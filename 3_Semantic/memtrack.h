@@ -0,0 +1,73 @@
+/****************************************************/
+/* File: memtrack.h                                 */
+/* Allocation tracking interface for the C-Minus    */
+/* compiler (--mem-report)                          */
+/****************************************************/
+
+#ifndef _MEMTRACK_H_
+#define _MEMTRACK_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* the kinds of object allocations are tagged with;
+ * the syntax tree and check results are allocated
+ * with mt_malloc, the symbol tables from pools with
+ * st_alloc
+ */
+typedef enum
+{
+    NodeMem,
+    NameMem,
+    TableMem,
+    ScopeMem,
+    BucketMem,
+    SymbolNameMem,
+    LineMem,
+    ArgumentMem,
+    CheckMem,
+    MemKindCount
+} MemKind;
+
+/* Procedure mt_enable turns the tracking on. It
+ * must come before the first tracked allocation,
+ * since blocks allocated before are not known when
+ * they are freed
+ */
+void mt_enable(void);
+
+/* Function mt_malloc allocates size bytes of kind
+ * and returns NULL when out of memory
+ */
+void* mt_malloc(size_t size, MemKind kind);
+
+/* Procedure mt_free frees a block of kind that was
+ * allocated with mt_malloc
+ */
+void mt_free(void* p, MemKind kind);
+
+/* Procedure mt_pool_add counts bytes of kind taken
+ * from a pool; owner keeps the bytes of every kind
+ * the pool holds
+ */
+void mt_pool_add(long owner[MemKindCount], MemKind kind, long bytes);
+
+/* Procedure mt_pool_release counts the bytes of
+ * owner as freed, when its pool is destroyed
+ */
+void mt_pool_release(long owner[MemKindCount]);
+
+/* Procedure mt_phase_allocs stores the number of
+ * allocations made in phase, a Phase, and the bytes
+ * they took in *allocs and *bytes
+ */
+void mt_phase_allocs(int phase, long* allocs, long* bytes);
+
+/* Procedure mt_print writes the allocation counts,
+ * bytes, live and peak bytes of every kind and the
+ * allocations of every phase, and the peak resident
+ * set size of the process, to out as text or JSON
+ */
+void mt_print(FILE* out, int json);
+
+#endif
@@ -0,0 +1,159 @@
+/****************************************************/
+/* File: parallel.c                                 */
+/* Work-stealing thread pool implementation         */
+/* for the C-Minus compiler                         */
+/* Each worker owns a range of indices, taken from  */
+/* the front; idle workers split ranges at the back */
+/****************************************************/
+
+#include <pthread.h>
+#include <unistd.h>
+#include "globals.h"
+#include "parallel.h"
+#include "events.h"
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    int begin;
+    int end;
+} WorkRange;
+
+typedef struct
+{
+    WorkRange* ranges;
+    int workers;
+    void (*work)(void*, int);
+    void* arg;
+} WorkPool;
+
+typedef struct
+{
+    WorkPool* pool;
+    int self;
+} Worker;
+
+int parallel_threads(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+/* Function takeOwn returns the next index of range,
+ * or -1 if it is empty
+ */
+static int takeOwn(WorkRange* range)
+{
+    int index = -1;
+    pthread_mutex_lock(&range->lock);
+    if (range->begin < range->end)
+        index = range->begin++;
+    pthread_mutex_unlock(&range->lock);
+    return index;
+}
+
+/* Function steal moves the upper half of the first
+ * non-empty range after self's into self's range and
+ * returns its first index, or -1 if all are empty
+ */
+static int steal(WorkPool* pool, int self)
+{
+    int k;
+    for (k = 1; k < pool->workers; ++k)
+    {
+        WorkRange* victim = &pool->ranges[(self + k) % pool->workers];
+        int mid, end;
+        pthread_mutex_lock(&victim->lock);
+        end = victim->end;
+        mid = end - (end - victim->begin + 1) / 2;
+        if (mid < end)
+            victim->end = mid;
+        pthread_mutex_unlock(&victim->lock);
+        if (mid < end)
+        {
+            WorkRange* own = &pool->ranges[self];
+            pthread_mutex_lock(&own->lock);
+            own->begin = mid + 1;
+            own->end = end;
+            pthread_mutex_unlock(&own->lock);
+            return mid;
+        }
+    }
+    return -1;
+}
+
+static void* runWorker(void* p)
+{
+    Worker* worker = (Worker*)p;
+    WorkPool* pool = worker->pool;
+    ev_begin("parallel", "worker");
+    for (;;)
+    {
+        int index = takeOwn(&pool->ranges[worker->self]);
+        if (index < 0)
+        {
+            index = steal(pool, worker->self);
+            if (index >= 0)
+                ev_instant("parallel", "steal");
+        }
+        if (index < 0)
+            break;
+        pool->work(pool->arg, index);
+    }
+    ev_end();
+    return NULL;
+}
+
+void parallel_for(int count, int threads, void (*work)(void* arg, int index), void* arg)
+{
+    WorkPool pool;
+    Worker* workers;
+    pthread_t* ids;
+    int* started;
+    int i;
+    if (threads > count)
+        threads = count;
+    if (threads <= 1)
+    {
+        for (i = 0; i < count; ++i)
+            work(arg, i);
+        return;
+    }
+    pool.ranges = (WorkRange*)malloc(threads * sizeof(WorkRange));
+    workers = (Worker*)malloc(threads * sizeof(Worker));
+    ids = (pthread_t*)malloc(threads * sizeof(pthread_t));
+    started = (int*)calloc(threads, sizeof(int));
+    if (pool.ranges == NULL || workers == NULL || ids == NULL || started == NULL)
+    {
+        fprintf(listing, "Out of memory error at line %d\n", lineno);
+        exit(1);
+    }
+    pool.workers = threads;
+    pool.work = work;
+    pool.arg = arg;
+    for (i = 0; i < threads; ++i)
+    {
+        pthread_mutex_init(&pool.ranges[i].lock, NULL);
+        pool.ranges[i].begin = (int)((long)count * i / threads);
+        pool.ranges[i].end = (int)((long)count * (i + 1) / threads);
+        workers[i].pool = &pool;
+        workers[i].self = i;
+    }
+    /* a range whose thread fails to start is stolen
+     * by the others
+     */
+    for (i = 1; i < threads; ++i)
+        started[i] = pthread_create(&ids[i], NULL, runWorker, &workers[i]) == 0;
+    runWorker(&workers[0]);
+    for (i = 1; i < threads; ++i)
+    {
+        if (started[i])
+            pthread_join(ids[i], NULL);
+    }
+    for (i = 0; i < threads; ++i)
+        pthread_mutex_destroy(&pool.ranges[i].lock);
+    free(started);
+    free(ids);
+    free(workers);
+    free(pool.ranges);
+}
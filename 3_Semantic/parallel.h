@@ -0,0 +1,24 @@
+/****************************************************/
+/* File: parallel.h                                 */
+/* Work-stealing thread pool interface for the      */
+/* C-Minus compiler                                 */
+/****************************************************/
+
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+/* Function parallel_threads returns the number of
+ * processors online, and at least 1
+ */
+int parallel_threads(void);
+
+/* Procedure parallel_for calls work(arg, i) for every
+ * i in [0, count) on up to threads threads, the
+ * calling one included, and returns when all calls
+ * have returned. Every thread starts on a contiguous
+ * share of the indices and, when it runs out, steals
+ * the upper half of what another thread has left
+ */
+void parallel_for(int count, int threads, void (*work)(void* arg, int index), void* arg);
+
+#endif
@@ -13,4 +13,11 @@
  */
 TreeNode* parse(void);
 
+/* Procedure parseDeclarations parses the program and
+ * passes every top-level declaration to emit as soon
+ * as it is complete, instead of building the tree.
+ * emit owns the declaration
+ */
+void parseDeclarations(void (*emit)(TreeNode*));
+
 #endif
@@ -0,0 +1,241 @@
+/****************************************************/
+/* File: peephole.c                                 */
+/* Peephole optimizer implementation for the        */
+/* C-Minus compiler                                 */
+/****************************************************/
+
+#include "globals.h"
+#include "code.h"
+#include "peephole.h"
+
+/* MAXWINDOW is the longest window a rule looks at */
+#define MAXWINDOW 2
+
+/* MAXPASSES bounds the passes over the program, in
+ * case rules keep rewriting each other's results
+ */
+#define MAXPASSES 8
+
+static int enabled = TRUE;
+
+/* the program being rewritten */
+static Instruction* program;
+static int size;
+static const int* labels;
+
+/* targets[i] is the number of labels that refer to
+ * instruction i
+ */
+static int* targets;
+
+/* Function nextKept returns the index of the first
+ * instruction kept from line i on, or size
+ */
+static int nextKept(int i)
+{
+    while (i < size && (program[i].op == NULL || program[i].deleted))
+        ++i;
+    return i;
+}
+
+/* Function targetOf returns the instruction label
+ * refers to, or NULL past the end of the program
+ */
+static Instruction* targetOf(int label)
+{
+    int i = nextKept(labels[label]);
+    return i < size ? &program[i] : NULL;
+}
+
+static int isTarget(Instruction* in)
+{
+    return targets[in - program] > 0;
+}
+
+/* Procedure delete deletes in; the labels that
+ * referred to it refer to the next instruction
+ */
+static void delete(Instruction* in)
+{
+    int i = in - program;
+    in->deleted = TRUE;
+    if (targets[i] > 0)
+    {
+        int next = nextKept(i);
+        if (next < size)
+            targets[next] += targets[i];
+        targets[i] = 0;
+    }
+}
+
+static int is(Instruction* in, char* op)
+{
+    return strcmp(in->op, op) == 0;
+}
+
+/* Function isJump tells whether in jumps to a
+ * label, conditionally or not
+ */
+static int isJump(Instruction* in)
+{
+    return in->label >= 0 && (in->op[0] == 'J' || (is(in, "LDA") && in->r == pc));
+}
+
+static int isGoto(Instruction* in)
+{
+    return in->label >= 0 && is(in, "LDA") && in->r == pc;
+}
+
+/* ST r,d(s); LD t,d(s)  =>  ST r,d(s); LDA t,0(r)
+ * and the load goes if t is r
+ */
+static int storeLoad(Instruction** w)
+{
+    Instruction *st = w[0], *ld = w[1];
+    if (!is(st, "ST") || !is(ld, "LD") || isTarget(ld) || ld->d != st->d || ld->s != st->s)
+        return FALSE;
+    if (ld->r == st->r)
+        delete(ld);
+    else
+    {
+        ld->op = "LDA";
+        ld->d = 0;
+        ld->s = st->r;
+    }
+    return TRUE;
+}
+
+/* a jump to an unconditional jump goes to its label */
+static int jumpChain(Instruction** w)
+{
+    Instruction* target;
+    if (!isJump(w[0]))
+        return FALSE;
+    target = targetOf(w[0]->label);
+    if (target == NULL || target == w[0] || !isGoto(target) || target->label == w[0]->label)
+        return FALSE;
+    w[0]->label = target->label;
+    return TRUE;
+}
+
+/* a jump to the next instruction goes */
+static int jumpNext(Instruction** w)
+{
+    if (!isJump(w[0]) || targetOf(w[0]->label) != w[1])
+        return FALSE;
+    delete(w[0]);
+    return TRUE;
+}
+
+/* Function isAddConst tells whether in is an LDA
+ * that adds a constant to a register other than pc
+ */
+static int isAddConst(Instruction* in)
+{
+    return is(in, "LDA") && in->label < 0 && in->r != pc && in->s != pc;
+}
+
+/* LDA r,k(s); LDA r,j(r)  =>  LDA r,k+j(s), as cgen
+ * adds the constants of a + 1 - 3 one at a time
+ */
+static int constChain(Instruction** w)
+{
+    Instruction *first = w[0], *second = w[1];
+    if (!isAddConst(first) || !isAddConst(second) || isTarget(second) || second->r != first->r ||
+        second->s != first->r)
+        return FALSE;
+    first->d += second->d;
+    delete(second);
+    return TRUE;
+}
+
+/* a rule rewrites a window of length consecutive
+ * instructions and returns TRUE if it applied. The
+ * window may span jump targets, which rules that
+ * remove or merge instructions must check
+ */
+typedef struct
+{
+    char* name;
+    int length;
+    int (*apply)(Instruction** w);
+    long hits;
+} Rule;
+
+static Rule rules[] = {
+    { "store-load", 2, storeLoad, 0 },
+    { "jump-chain", 1, jumpChain, 0 },
+    { "jump-next", 2, jumpNext, 0 },
+    { "const-chain", 2, constChain, 0 }
+};
+
+#define RULECOUNT ((int)(sizeof(rules) / sizeof(rules[0])))
+
+/* Function window fills w with the length
+ * instructions kept from line i on
+ */
+static int window(int i, int length, Instruction** w)
+{
+    int n;
+    for (n = 0; n < length; ++n)
+    {
+        i = nextKept(i);
+        if (i >= size)
+            return FALSE;
+        w[n] = &program[i++];
+    }
+    return TRUE;
+}
+
+void pp_enable(int on)
+{
+    enabled = on;
+}
+
+void pp_run(Instruction* code, int codeSize, const int* codeLabels, int labelCount)
+{
+    Instruction* w[MAXWINDOW];
+    int pass, changed, i, r;
+    if (!enabled)
+        return;
+    program = code;
+    size = codeSize;
+    labels = codeLabels;
+    targets = malloc((size + 1) * sizeof(int));
+    if (targets == NULL)
+    {
+        fprintf(listing, "Out of memory error at line %d\n", lineno);
+        exit(1);
+    }
+    changed = TRUE;
+    for (pass = 0; pass < MAXPASSES && changed; ++pass)
+    {
+        changed = FALSE;
+        memset(targets, 0, (size + 1) * sizeof(int));
+        for (i = 0; i < labelCount; ++i)
+            if (labels[i] >= 0)
+                ++targets[nextKept(labels[i])];
+        for (i = nextKept(0); i < size; i = nextKept(i + 1))
+        {
+            for (r = 0; r < RULECOUNT && !program[i].deleted; ++r)
+            {
+                if (window(i, rules[r].length, w) && rules[r].apply(w))
+                {
+                    ++rules[r].hits;
+                    changed = TRUE;
+                }
+            }
+        }
+    }
+    free(targets);
+    targets = NULL;
+}
+
+void pp_print(FILE* out)
+{
+    int r;
+    fprintf(out, "Peephole rule     Hits\n");
+    fprintf(out, "-------------  -------\n");
+    for (r = 0; r < RULECOUNT; ++r)
+        fprintf(out, "%-13s  %7ld\n", rules[r].name, rules[r].hits);
+}
@@ -0,0 +1,31 @@
+/****************************************************/
+/* File: peephole.h                                 */
+/* Peephole optimizer interface for the C-Minus     */
+/* compiler (rewrites the emitted TM instructions)  */
+/****************************************************/
+
+#ifndef _PEEPHOLE_H_
+#define _PEEPHOLE_H_
+
+#include "globals.h"
+#include "code.h"
+
+/* Procedure pp_enable enables or disables the
+ * peephole pass (enabled by default)
+ */
+void pp_enable(int enabled);
+
+/* Procedure pp_run rewrites the size lines of
+ * program in place until no rule applies. labels[l]
+ * is the index of the first instruction label l
+ * refers to, or -1; deleting that instruction moves
+ * the label to the next one kept
+ */
+void pp_run(Instruction* program, int size, const int* labels, int labelCount);
+
+/* Procedure pp_print writes the number of times
+ * each rule applied to out
+ */
+void pp_print(FILE* out);
+
+#endif
@@ -0,0 +1,342 @@
+/****************************************************/
+/* File: phase.c                                    */
+/* Phase timing and counters implementation         */
+/* for the C-Minus compiler                         */
+/* Wall, CPU and heap are sampled when a phase is   */
+/* entered or left and charged to the innermost one */
+/****************************************************/
+
+#include <malloc.h>
+#include <time.h>
+#include "globals.h"
+#include "phase.h"
+#include "memtrack.h"
+#include "events.h"
+
+/* MAXPHASEDEPTH is the deepest nesting of phases */
+#define MAXPHASEDEPTH 16
+
+/* MAXKIND is the number of kinds of the largest
+ * node kind, ExpKind
+ */
+#define MAXKIND 6
+
+typedef struct
+{
+    double wall;
+    double cpu;
+    long heap; /* net growth of the heap in use */
+    long entries;
+} PhaseStats;
+
+static const char* phaseName[PhaseCount] = {
+    "scan", "parse", "buildSymtab", "typeCheck", "analyze", "callgraph", "fold", "ir", "codegen", "output"
+};
+
+static const char* nodeKindName[] = { "StmtK", "ExpK", "DeclarationK" };
+static const int kindCount[] = { 4, 6, 4 };
+static const char* kindName[][MAXKIND] = {
+    { "CompoundK", "SelectionK", "IterationK", "ReturnK" },
+    { "AssignmentK", "OperatorK", "ConstantK", "CallK", "VarK", "TypeK" },
+    { "FuncK", "VarDeclarationK", "ParameterK", "VoidParameterK" }
+};
+
+typedef enum
+{
+    KeywordToken,
+    IdToken,
+    NumToken,
+    SymbolToken,
+    ErrorToken,
+    TokenClassCount
+} TokenClass;
+
+static const char* tokenClassName[TokenClassCount] = {
+    "keywords", "identifiers", "numbers", "symbols", "errors"
+};
+
+static int enabled = FALSE;
+
+static PhaseStats phases[PhaseCount];
+static Phase stack[MAXPHASEDEPTH];
+static int depth = 0;
+
+/* the samples taken when the innermost phase was
+ * last charged
+ */
+static double markWall, markCpu;
+static long markHeap;
+
+static double scanStart, scanStartCpu;
+
+static long tokens[TokenClassCount];
+static long nodes[3][MAXKIND];
+static long scopeCount = -1, symbolCount;
+
+static double readClock(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long heapInUse(void)
+{
+    struct mallinfo2 mi = mallinfo2();
+    return (long)(mi.uordblks + mi.hblkhd);
+}
+
+/* Procedure charge adds the time and heap growth
+ * since the last sample to the innermost phase
+ */
+static void charge(void)
+{
+    double wall = readClock(CLOCK_MONOTONIC);
+    double cpu = readClock(CLOCK_PROCESS_CPUTIME_ID);
+    long heap = heapInUse();
+    if (depth > 0)
+    {
+        PhaseStats* p = &phases[stack[depth - 1]];
+        p->wall += wall - markWall;
+        p->cpu += cpu - markCpu;
+        p->heap += heap - markHeap;
+    }
+    markWall = wall;
+    markCpu = cpu;
+    markHeap = heap;
+}
+
+void ph_enable(void)
+{
+    enabled = TRUE;
+}
+
+/* the stack of phases is kept also when the
+ * accounting is off, for ph_current and for the
+ * spans of --trace-out
+ */
+void ph_push(Phase phase)
+{
+    if (depth == MAXPHASEDEPTH)
+    {
+        fprintf(stderr, "phases nested too deep\n");
+        exit(1);
+    }
+    ev_begin("phase", phaseName[phase]);
+    if (enabled)
+    {
+        charge();
+        ++phases[phase].entries;
+    }
+    stack[depth++] = phase;
+}
+
+void ph_pop(void)
+{
+    if (depth == 0)
+        return;
+    if (enabled)
+        charge();
+    --depth;
+    ev_end();
+}
+
+/* Function scanNested returns TRUE if the scanner
+ * is called from a phase other than the scan phase
+ */
+static int scanNested(void)
+{
+    return depth == 0 || stack[depth - 1] != ScanPhase;
+}
+
+Phase ph_current(void)
+{
+    return depth > 0 ? stack[depth - 1] : PhaseCount;
+}
+
+const char* ph_name(Phase phase)
+{
+    return phaseName[phase];
+}
+
+void ph_scan_begin(void)
+{
+    if (enabled && scanNested())
+    {
+        scanStart = readClock(CLOCK_MONOTONIC);
+        scanStartCpu = readClock(CLOCK_THREAD_CPUTIME_ID);
+    }
+}
+
+void ph_scan_end(TokenType token)
+{
+    TokenClass c;
+    if (!enabled)
+        return;
+    /* move the time from the phase that called the
+     * scanner to the scan phase. The scanner runs on
+     * the thread that calls it, whose CPU time is part
+     * of the CPU time of the process the caller is
+     * charged
+     */
+    if (scanNested())
+    {
+        double elapsed = readClock(CLOCK_MONOTONIC) - scanStart;
+        double cpu = readClock(CLOCK_THREAD_CPUTIME_ID) - scanStartCpu;
+        phases[ScanPhase].wall += elapsed;
+        phases[ScanPhase].cpu += cpu;
+        if (depth > 0)
+        {
+            phases[stack[depth - 1]].wall -= elapsed;
+            phases[stack[depth - 1]].cpu -= cpu;
+        }
+    }
+    switch (token)
+    {
+        case ENDFILE:
+            return;
+        case IF:
+        case ELSE:
+        case WHILE:
+        case RETURN:
+        case INT:
+        case VOID:
+            c = KeywordToken;
+            break;
+        case ID:
+            c = IdToken;
+            break;
+        case NUM:
+            c = NumToken;
+            break;
+        case ERROR:
+            c = ErrorToken;
+            break;
+        default:
+            c = SymbolToken;
+            break;
+    }
+    ++tokens[c];
+}
+
+void ph_count_tree(TreeNode* t)
+{
+    int i;
+    if (!enabled)
+        return;
+    for (; t != NULL; t = t->sibling)
+    {
+        switch (t->nodekind)
+        {
+            case StmtK:
+                ++nodes[StmtK][t->kind.stmt];
+                break;
+            case ExpK:
+                ++nodes[ExpK][t->kind.exp];
+                break;
+            case DeclarationK:
+                ++nodes[DeclarationK][t->kind.declaration];
+                break;
+        }
+        for (i = 0; i < MAXCHILDREN; ++i)
+            ph_count_tree(t->child[i]);
+    }
+}
+
+void ph_count_symtab(Symtab tab)
+{
+    if (enabled && tab != NULL)
+        st_count(tab, &scopeCount, &symbolCount);
+}
+
+static long sum(const long* counts, int n)
+{
+    long total = 0;
+    int i;
+    for (i = 0; i < n; ++i)
+        total += counts[i];
+    return total;
+}
+
+static void printText(FILE* out)
+{
+    PhaseStats total;
+    long allocs, bytes, totalAllocs = 0, totalBytes = 0;
+    int p, k, i;
+    memset(&total, 0, sizeof(total));
+    fprintf(out, "\n< Compilation Report >\n");
+    fprintf(out, "Phase         Wall (ms)   CPU (ms)    Allocs   Bytes (KB)   Heap (KB)\n");
+    fprintf(out, "-----------   ---------   --------   -------   ----------   ---------\n");
+    for (p = 0; p < PhaseCount; ++p)
+    {
+        PhaseStats* s = &phases[p];
+        if (s->entries == 0 && (p != ScanPhase || sum(tokens, TokenClassCount) == 0))
+            continue;
+        mt_phase_allocs(p, &allocs, &bytes);
+        fprintf(out, "%-11s   %9.3f  %9.3f   %7ld   %10.1f  %10.1f\n",
+                phaseName[p], s->wall * 1e3, s->cpu * 1e3, allocs, bytes / 1024.0, s->heap / 1024.0);
+        total.wall += s->wall;
+        total.cpu += s->cpu;
+        total.heap += s->heap;
+        totalAllocs += allocs;
+        totalBytes += bytes;
+    }
+    fprintf(out, "%-11s   %9.3f  %9.3f   %7ld   %10.1f  %10.1f\n",
+            "total", total.wall * 1e3, total.cpu * 1e3, totalAllocs, totalBytes / 1024.0, total.heap / 1024.0);
+    fprintf(out, "\nTokens: %ld ", sum(tokens, TokenClassCount));
+    for (i = 0; i < TokenClassCount; ++i)
+        fprintf(out, " %s %ld", tokenClassName[i], tokens[i]);
+    fprintf(out, "\nNodes: %ld\n", sum(nodes[0], 3 * MAXKIND));
+    if (sum(nodes[0], 3 * MAXKIND) == 0)
+        return;
+    fprintf(out, "\nNode Kind      Kind               Count\n");
+    fprintf(out, "---------      ----               -----\n");
+    for (k = 0; k < 3; ++k)
+        for (i = 0; i < kindCount[k]; ++i)
+            if (nodes[k][i])
+                fprintf(out, "%-14s %-15s %8ld\n", nodeKindName[k], kindName[k][i], nodes[k][i]);
+    if (scopeCount >= 0)
+        fprintf(out, "\nScopes: %ld  Symbols: %ld\n", scopeCount, symbolCount);
+}
+
+static void printJson(FILE* out)
+{
+    long allocs, bytes;
+    int p, k, i, first = TRUE;
+    fprintf(out, "{\n  \"phases\": [");
+    for (p = 0; p < PhaseCount; ++p)
+    {
+        PhaseStats* s = &phases[p];
+        if (s->entries == 0 && (p != ScanPhase || sum(tokens, TokenClassCount) == 0))
+            continue;
+        mt_phase_allocs(p, &allocs, &bytes);
+        fprintf(out, "%s\n    {\"name\": \"%s\", \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"allocs\": %ld, \"bytes\": %ld, \"heap_bytes\": %ld}",
+                first ? "" : ",", phaseName[p], s->wall * 1e3, s->cpu * 1e3, allocs, bytes, s->heap);
+        first = FALSE;
+    }
+    fprintf(out, "\n  ],\n  \"tokens\": {\"total\": %ld", sum(tokens, TokenClassCount));
+    for (i = 0; i < TokenClassCount; ++i)
+        fprintf(out, ", \"%s\": %ld", tokenClassName[i], tokens[i]);
+    fprintf(out, "},\n  \"nodes\": {\"total\": %ld", sum(nodes[0], 3 * MAXKIND));
+    for (k = 0; k < 3; ++k)
+    {
+        fprintf(out, ",\n    \"%s\": {", nodeKindName[k]);
+        for (i = 0; i < kindCount[k]; ++i)
+            fprintf(out, "%s\"%s\": %ld", i ? ", " : "", kindName[k][i], nodes[k][i]);
+        fprintf(out, "}");
+    }
+    fprintf(out, "\n  }");
+    if (scopeCount >= 0)
+        fprintf(out, ",\n  \"scopes\": %ld,\n  \"symbols\": %ld", scopeCount, symbolCount);
+    fprintf(out, "\n}\n");
+}
+
+void ph_print(FILE* out, int json)
+{
+    if (!enabled)
+        return;
+    if (json)
+        printJson(out);
+    else
+        printText(out);
+}
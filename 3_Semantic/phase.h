@@ -0,0 +1,81 @@
+/****************************************************/
+/* File: phase.h                                    */
+/* Phase timing and counters interface for the      */
+/* C-Minus compiler (--time-passes)                 */
+/****************************************************/
+
+#ifndef _PHASE_H_
+#define _PHASE_H_
+
+#include "globals.h"
+#include "symtab.h"
+
+/* the phases time is charged to; analyze is the
+ * fused single-pass and streaming analysis
+ */
+typedef enum
+{
+    ScanPhase,
+    ParsePhase,
+    BuildPhase,
+    CheckPhase,
+    AnalyzePhase,
+    CallGraphPhase,
+    FoldPhase,
+    IrPhase,
+    CodegenPhase,
+    OutputPhase,
+    PhaseCount
+} Phase;
+
+/* Procedure ph_enable turns the accounting on;
+ * until then the procedures below only keep track
+ * of the current phase
+ */
+void ph_enable(void);
+
+/* Procedures ph_push and ph_pop enter and leave a
+ * phase. Phases nest, and time spent in a nested
+ * phase is charged to it alone. Every phase is also
+ * a span of --trace-out
+ */
+void ph_push(Phase phase);
+void ph_pop(void);
+
+/* Function ph_current returns the innermost phase,
+ * or PhaseCount outside every phase
+ */
+Phase ph_current(void);
+
+/* Function ph_name returns the name of phase */
+const char* ph_name(Phase phase);
+
+/* Procedures ph_scan_begin and ph_scan_end bracket
+ * one call of the scanner and count the token it
+ * returned. The wall time and the CPU time of the
+ * calling thread are moved from the caller's phase
+ * to the scan phase
+ */
+void ph_scan_begin(void);
+void ph_scan_end(TokenType token);
+
+/* Procedure ph_count_tree counts the nodes of the
+ * syntax tree t and of its siblings by kind
+ */
+void ph_count_tree(TreeNode* t);
+
+/* Procedure ph_count_symtab counts the scopes and
+ * symbols of tab
+ */
+void ph_count_symtab(Symtab tab);
+
+/* Procedure ph_print writes the wall time, CPU time,
+ * tracked allocations and bytes allocated, and heap
+ * growth of every phase that ran, and the token,
+ * node, scope and symbol counts, to out as text or
+ * as JSON. Allocations are tracked by memtrack, which
+ * must be enabled too
+ */
+void ph_print(FILE* out, int json);
+
+#endif
@@ -0,0 +1,205 @@
+/****************************************************/
+/* File: reanalyze.c                                */
+/* Incremental analysis test driver for the C-Minus */
+/* compiler: analyzes a program, then an edited     */
+/* copy of it against the first version, and        */
+/* compares the listing and the annotations of the  */
+/* tree with those of a full analysis               */
+/****************************************************/
+
+#include "globals.h"
+#include "util.h"
+#include "scan.h"
+#include "parse.h"
+#include "analyze.h"
+
+/* allocate global variables */
+int lineno = 0;
+FILE* source;
+FILE* listing;
+FILE* code;
+
+/* allocate tracing flags; the analysis is traced so
+ * that the listing holds the symbol table and its
+ * reference lines
+ */
+int EchoSource = FALSE;
+int TraceScan = FALSE;
+int TraceParse = FALSE;
+int TraceAnalyze = TRUE;
+int TraceIr = FALSE;
+int TraceCode = FALSE;
+
+int Error = FALSE;
+
+/* singlePass selects analyze instead of buildSymtab
+ * followed by typeCheck
+ */
+static int singlePass = FALSE;
+
+/* Function analyzeFile parses the program in file and
+ * analyzes it against previous (or NULL). It returns
+ * the new version, and sets *tree to the syntax tree
+ * and *output to what was written to the listing.
+ * A program with syntax errors is not analyzed: the
+ * driver stops
+ */
+static Symtab analyzeFile(char* file, Symtab previous, TreeNode** tree, char** output)
+{
+    Symtab tab;
+    long size;
+    source = fopen(file, "r");
+    if (source == NULL)
+    {
+        fprintf(stderr, "File %s not found\n", file);
+        exit(1);
+    }
+    listing = stdout;
+    Error = FALSE;
+    resetScanner();
+    *tree = parse();
+    if (Error)
+    {
+        printf("%s has syntax errors\n", file);
+        exit(1);
+    }
+    listing = tmpfile();
+    if (listing == NULL)
+    {
+        fprintf(stderr, "Out of memory error at line %d\n", lineno);
+        exit(1);
+    }
+    if (singlePass)
+    {
+        tab = analyze(*tree, previous);
+    }
+    else
+    {
+        tab = buildSymtab(*tree, previous);
+        typeCheck(*tree, tab);
+    }
+    size = ftell(listing);
+    *output = (char*)malloc(size + 1);
+    if (*output == NULL)
+    {
+        fprintf(stderr, "Out of memory error at line %d\n", lineno);
+        exit(1);
+    }
+    rewind(listing);
+    size = (long)fread(*output, 1, size, listing);
+    (*output)[size] = '\0';
+    fclose(listing);
+    fclose(source);
+    listing = stdout;
+    return tab;
+}
+
+/* Function sharedTables returns the number of
+ * function tables of tab that are shared with
+ * previous, and sets *checked to the number of
+ * functions of tab that were type checked, not given
+ * the check result of previous
+ */
+static int sharedTables(Symtab tab, Symtab previous, int* checked)
+{
+    int i, j, n = 0;
+    *checked = tab->unitCount;
+    for (i = 0; i < tab->unitCount; ++i)
+        for (j = 0; j < previous->unitCount; ++j)
+            if (tab->units[i] == previous->units[j])
+            {
+                ++n;
+                if (tab->checks[i] != NULL && tab->checks[i] == previous->checks[j])
+                    --*checked;
+                break;
+            }
+    return n;
+}
+
+/* the versions whose trees sameAnnotations compares */
+static Symtab tabA, tabB;
+
+/* Function sameSymbol tells whether a and b are the
+ * same declaration in tabA and tabB, or both NULL
+ */
+static int sameSymbol(BucketList a, BucketList b)
+{
+    if (a == NULL || b == NULL)
+        return a == b;
+    return st_declaration_line(tabA, a) == st_declaration_line(tabB, b) && strcmp(a->name, b->name) == 0;
+}
+
+/* Function sameAnnotations tells whether the
+ * expressions of the lists a and b, parsed from the
+ * same source, have the same types and declarations
+ */
+static int sameAnnotations(TreeNode* a, TreeNode* b)
+{
+    int i;
+    for (; a != NULL && b != NULL; a = a->sibling, b = b->sibling)
+    {
+        if (a->nodekind == ExpK &&
+            (a->type != b->type || a->isarray != b->isarray || !sameSymbol(a->symbol, b->symbol)))
+        {
+            printf("annotations differ at line %d\n", a->lineno);
+            return FALSE;
+        }
+        for (i = 0; i < MAXCHILDREN; i++)
+            if (!sameAnnotations(a->child[i], b->child[i]))
+                return FALSE;
+    }
+    return a == b;
+}
+
+int main(int argc, char* argv[])
+{
+    TreeNode *first, *edited, *full;
+    char *firstOutput, *editedOutput, *fullOutput;
+    Symtab v1, v2, v3;
+    int i = 1, shared, checked, same;
+    if (argc > 1 && strcmp(argv[1], "--single-pass") == 0)
+    {
+        singlePass = TRUE;
+        ++i;
+    }
+    if (argc - i != 2)
+    {
+        fprintf(stderr, "usage: %s [--single-pass] <filename> <edited filename>\n", argv[0]);
+        exit(1);
+    }
+    listing = stdout;
+    v1 = analyzeFile(argv[i], NULL, &first, &firstOutput);
+    v2 = analyzeFile(argv[i + 1], v1, &edited, &editedOutput);
+    shared = sharedTables(v2, v1, &checked);
+    /* the first version may go before the second */
+    st_release(v1);
+    freeTree(first);
+    v3 = analyzeFile(argv[i + 1], NULL, &full, &fullOutput);
+    printf("shared %d of %d function tables\n", shared, v2->unitCount);
+    printf("checked %d of %d functions\n", checked, v2->unitCount);
+    same = strcmp(editedOutput, fullOutput) == 0;
+    tabA = v2;
+    tabB = v3;
+    if (!same)
+    {
+        printf("listing differs from a full analysis\n");
+        printf("\n< Incremental >\n%s\n< Full >\n%s\n", editedOutput, fullOutput);
+    }
+    /* later passes read the types and declarations */
+    else if (!sameAnnotations(edited, full))
+    {
+        same = FALSE;
+    }
+    else
+    {
+        printf("same as a full analysis\n");
+    }
+    st_release(v2);
+    st_release(v3);
+    freeTree(edited);
+    freeTree(full);
+    free(firstOutput);
+    free(editedOutput);
+    free(fullOutput);
+    return same ? 0 : 1;
+}
@@ -0,0 +1,31 @@
+import os
+import re
+import subprocess
+
+def expected(path, key):
+    with open(path, 'r') as f:
+        for line in f.readlines():
+            if f'/* {key}:' in line:
+                return re.sub(r'.*/\* ' + key + r':(.*?)\*/.*', r'\1', line).split()
+    return []
+
+def main():
+    cases = [case for case in os.listdir('./test_case_r') if not case.endswith('.edit.txt')]
+    print(cases)
+
+    for case in sorted(cases):
+        path = './test_case_r/' + str(case)
+        edited = path[:path.rfind('.')] + '.edit.txt'
+        for mode in ['two-pass', 'single-pass']:
+            options = ['--single-pass'] if mode == 'single-pass' else []
+            proc = subprocess.run(['./cminus_reanalyze'] + options + [path, edited], capture_output=True)
+            r = proc.stdout.decode('utf-8')
+            counts = re.findall(r'shared ([0-9]+) of', r) + re.findall(r'checked ([0-9]+) of', r)
+            want = expected(edited, 'shared') + expected(edited, 'checked')
+            if proc.returncode != 0 or counts != want:
+                print(f'테스트 실패: {case} ({mode}) {counts} != {want}\n{r}')
+            else:
+                print(f"테스트 성공: {case} ({mode})")
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,787 @@
+/****************************************************/
+/* File: regalloc.c                                 */
+/* Register allocation by graph coloring for the    */
+/* C-Minus compiler: interference graph, coalescing */
+/* with the conservative test of Briggs, and        */
+/* optimistic coloring. Temps kept in memory share  */
+/* frame slots by their live intervals              */
+/****************************************************/
+
+#include <limits.h>
+#include "globals.h"
+#include "code.h"
+#include "regalloc.h"
+
+/* K is the number of registers for temps */
+#define K (LASTTEMP - FIRSTTEMP + 1)
+
+/* MAXTEMPS bounds the temps, and MAXSETBITS the
+ * size of the live sets, of a function whose
+ * interference graph is built; the temps of larger
+ * functions are all kept in memory
+ */
+#define MAXTEMPS 16384
+#define MAXSETBITS (1L << 27)
+
+typedef unsigned int Word;
+#define WORDBITS 32
+
+static void* allocOrDie(size_t size)
+{
+    void* p = calloc(1, size);
+    if (p == NULL)
+    {
+        fprintf(listing, "Out of memory error at line %d\n", lineno);
+        exit(1);
+    }
+    return p;
+}
+
+typedef struct
+{
+    int* items;
+    int count;
+    int capacity;
+} IntList;
+
+static void append(IntList* list, int item)
+{
+    if (list->count == list->capacity)
+    {
+        list->capacity = list->capacity ? 2 * list->capacity : 4;
+        list->items = realloc(list->items, list->capacity * sizeof(int));
+        if (list->items == NULL)
+        {
+            fprintf(listing, "Out of memory error at line %d\n", lineno);
+            exit(1);
+        }
+    }
+    list->items[list->count++] = item;
+}
+
+/* the function being allocated and its graph */
+static IrFunction function;
+static int n;          /* number of temps */
+static int words;      /* words of a set of temps */
+static Word* matrix;   /* edges, lower triangle by rows */
+static IntList* adj;   /* neighbors, by temp */
+static int* alias;     /* temp a temp is merged into */
+static long* weight;   /* uses weighted by loop depth */
+static long* callCost; /* saves around the calls it crosses */
+static int* useCount;  /* number of reads */
+static int* degree;
+
+/* Function loopWeight returns the weight of an
+ * access at loop depth depth
+ */
+static long loopWeight(int depth)
+{
+    return 1L << (3 * (depth < 5 ? depth : 5));
+}
+
+static int find(int t)
+{
+    while (alias[t] != t)
+        t = alias[t] = alias[alias[t]];
+    return t;
+}
+
+static long bitOf(int a, int b)
+{
+    return a > b ? (long)a * (a - 1) / 2 + b : (long)b * (b - 1) / 2 + a;
+}
+
+static int interferes(int a, int b)
+{
+    long bit = bitOf(a, b);
+    return (matrix[bit / WORDBITS] >> (bit % WORDBITS)) & 1;
+}
+
+static void addEdge(int a, int b)
+{
+    long bit;
+    if (a == b || interferes(a, b))
+        return;
+    bit = bitOf(a, b);
+    matrix[bit / WORDBITS] |= 1u << (bit % WORDBITS);
+    append(&adj[a], b);
+    append(&adj[b], a);
+    ++degree[a];
+    ++degree[b];
+}
+
+/* Procedure forUses calls visit on every temp in
+ * read
+ */
+static void forUses(IrInstr in, void (*visit)(int temp, void* data), void* data)
+{
+    int k;
+    if (in->a.kind == IrTemp)
+        visit(in->a.value, data);
+    if (in->b.kind == IrTemp)
+        visit(in->b.value, data);
+    for (k = 0; k < in->argCount; ++k)
+        if (in->args[k].kind == IrTemp)
+            visit(in->args[k].value, data);
+}
+
+static void setBit(int temp, void* set)
+{
+    ((Word*)set)[temp / WORDBITS] |= 1u << (temp % WORDBITS);
+}
+
+static void clearBit(Word* set, int temp)
+{
+    set[temp / WORDBITS] &= ~(1u << (temp % WORDBITS));
+}
+
+/* Function nextMember returns the least temp of
+ * set from temp on, or -1 if there is none
+ */
+static int nextMember(Word* set, int temp)
+{
+    int w = temp / WORDBITS;
+    Word bits;
+    if (w >= words)
+        return -1;
+    bits = set[w] >> (temp % WORDBITS);
+    while (bits == 0)
+    {
+        if (++w >= words)
+            return -1;
+        temp = w * WORDBITS;
+        bits = set[w];
+    }
+    while (!(bits & 1))
+    {
+        bits >>= 1;
+        ++temp;
+    }
+    return temp;
+}
+
+/* the weight of the block being counted */
+static long blockWeight;
+
+static void countUse(int temp, void* weight)
+{
+    ++useCount[temp];
+    ((long*)weight)[temp] += blockWeight;
+}
+
+/* Procedure countUses counts and weighs the reads
+ * and the writes of every temp. A parameter read
+ * from its slot costs nothing, as the slot is the
+ * home of the temp when it is kept in memory
+ */
+static void countUses(void)
+{
+    IrInstr in;
+    int i;
+    for (i = 0; i < function->blockCount; ++i)
+    {
+        blockWeight = loopWeight(function->blocks[i]->depth);
+        for (in = function->blocks[i]->first; in != NULL; in = in->next)
+        {
+            forUses(in, countUse, weight);
+            if (in->dst.kind == IrTemp && in->op != IrParam)
+                weight[in->dst.value] += blockWeight;
+        }
+    }
+}
+
+/* Function findLiveOut returns the temps live out
+ * of every block, words words per block
+ */
+static Word* findLiveOut(void)
+{
+    int blocks = function->blockCount;
+    Word* liveIn = (Word*)allocOrDie((size_t)blocks * words * sizeof(Word));
+    Word* liveOut = (Word*)allocOrDie((size_t)blocks * words * sizeof(Word));
+    Word* gen = (Word*)allocOrDie((size_t)blocks * words * sizeof(Word));
+    Word* kill = (Word*)allocOrDie((size_t)blocks * words * sizeof(Word));
+    IrInstr in;
+    int i, s, w, changed = TRUE;
+    for (i = 0; i < blocks; ++i)
+    {
+        Word* g = gen + (size_t)i * words;
+        Word* k = kill + (size_t)i * words;
+        for (in = function->blocks[i]->last; in != NULL; in = in->prev)
+        {
+            if (in->dst.kind == IrTemp)
+            {
+                setBit(in->dst.value, k);
+                clearBit(g, in->dst.value);
+            }
+            forUses(in, setBit, g);
+        }
+    }
+    while (changed)
+    {
+        changed = FALSE;
+        for (i = blocks - 1; i >= 0; --i)
+        {
+            IrBlock b = function->blocks[i];
+            Word* out = liveOut + (size_t)i * words;
+            Word* inSet = liveIn + (size_t)i * words;
+            Word* g = gen + (size_t)i * words;
+            Word* k = kill + (size_t)i * words;
+            for (s = 0; s < b->succCount; ++s)
+            {
+                Word* succIn = liveIn + (size_t)b->succ[s]->id * words;
+                for (w = 0; w < words; ++w)
+                    out[w] |= succIn[w];
+            }
+            for (w = 0; w < words; ++w)
+            {
+                Word next = g[w] | (out[w] & ~k[w]);
+                if (next != inSet[w])
+                {
+                    inSet[w] = next;
+                    changed = TRUE;
+                }
+            }
+        }
+    }
+    free(liveIn);
+    free(gen);
+    free(kill);
+    return liveOut;
+}
+
+/* Procedure buildGraph makes every temp written
+ * interfere with the temps live after the write,
+ * but for the source of a move, and charges the
+ * temps live across a call with their saves
+ */
+static void buildGraph(Word* liveOut)
+{
+    Word* live = (Word*)allocOrDie(words * sizeof(Word));
+    IrInstr in;
+    int i, t;
+    long cost;
+    for (i = 0; i < function->blockCount; ++i)
+    {
+        memcpy(live, liveOut + (size_t)i * words, words * sizeof(Word));
+        cost = 2 * loopWeight(function->blocks[i]->depth);
+        for (in = function->blocks[i]->last; in != NULL; in = in->prev)
+        {
+            if (in->dst.kind == IrTemp)
+            {
+                int d = in->dst.value;
+                int source = in->op == IrMove && in->a.kind == IrTemp ? in->a.value : -1;
+                for (t = nextMember(live, 0); t >= 0; t = nextMember(live, t + 1))
+                    if (t != source)
+                        addEdge(d, t);
+                clearBit(live, d);
+            }
+            if (in->op == IrCall)
+                for (t = nextMember(live, 0); t >= 0; t = nextMember(live, t + 1))
+                    callCost[t] += cost;
+            forUses(in, setBit, live);
+        }
+    }
+    free(live);
+}
+
+/* the stamp of the neighbor count in progress */
+static int* seen;
+static int stamp;
+
+/* Function briggs applies the test of Briggs: a
+ * and b may be merged if their merged neighbors of
+ * K or more neighbors are fewer than K
+ */
+static int briggs(int a, int b)
+{
+    int nodes[2], i, j, significant = 0;
+    nodes[0] = a;
+    nodes[1] = b;
+    ++stamp;
+    for (i = 0; i < 2; ++i)
+    {
+        for (j = 0; j < adj[nodes[i]].count; ++j)
+        {
+            int m = find(adj[nodes[i]].items[j]);
+            if (seen[m] == stamp || m == a || m == b)
+                continue;
+            seen[m] = stamp;
+            if (degree[m] >= K && ++significant >= K)
+                return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* Function george applies the test of George: b
+ * may be merged into a if every neighbor of b of K
+ * or more neighbors is already a neighbor of a
+ */
+static int george(int a, int b)
+{
+    int j;
+    for (j = 0; j < adj[b].count; ++j)
+    {
+        int m = find(adj[b].items[j]);
+        if (m != a && degree[m] >= K && !interferes(a, m))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+static int canMerge(int a, int b)
+{
+    return briggs(a, b) || george(a, b) || george(b, a);
+}
+
+/* Procedure merge merges the temp b into a */
+static void merge(int a, int b)
+{
+    int j;
+    alias[b] = a;
+    weight[a] += weight[b];
+    callCost[a] += callCost[b];
+    useCount[a] += useCount[b];
+    for (j = 0; j < adj[b].count; ++j)
+    {
+        int m = find(adj[b].items[j]);
+        if (m != a)
+            addEdge(a, m);
+    }
+}
+
+typedef struct
+{
+    IrInstr move;
+    int depth;
+} Move;
+
+static int deeper(const void* a, const void* b)
+{
+    return ((const Move*)b)->depth - ((const Move*)a)->depth;
+}
+
+static void renameOperand(IrOperand* o)
+{
+    if (o->kind == IrTemp)
+        o->value = find(o->value);
+}
+
+/* Procedure coalesce merges the temps of the moves
+ * that do not interfere, innermost loops first, and
+ * removes the moves
+ */
+static void coalesce(void)
+{
+    Move* moves;
+    IrInstr in, next;
+    int count = 0, i, k;
+    for (i = 0; i < function->blockCount; ++i)
+        for (in = function->blocks[i]->first; in != NULL; in = in->next)
+            if (in->op == IrMove && in->dst.kind == IrTemp && in->a.kind == IrTemp)
+                ++count;
+    moves = (Move*)allocOrDie((count + 1) * sizeof(Move));
+    count = 0;
+    for (i = 0; i < function->blockCount; ++i)
+    {
+        for (in = function->blocks[i]->first; in != NULL; in = in->next)
+        {
+            if (in->op == IrMove && in->dst.kind == IrTemp && in->a.kind == IrTemp)
+            {
+                moves[count].move = in;
+                moves[count++].depth = function->blocks[i]->depth;
+            }
+        }
+    }
+    qsort(moves, count, sizeof(Move), deeper);
+    for (i = 0; i < count; ++i)
+    {
+        int a = find(moves[i].move->dst.value);
+        int b = find(moves[i].move->a.value);
+        if (a != b && !interferes(a, b) && canMerge(a, b))
+            merge(a, b);
+    }
+    free(moves);
+    for (i = 0; i < function->blockCount; ++i)
+    {
+        IrBlock b = function->blocks[i];
+        for (in = b->first; in != NULL; in = next)
+        {
+            next = in->next;
+            renameOperand(&in->dst);
+            renameOperand(&in->a);
+            renameOperand(&in->b);
+            for (k = 0; k < in->argCount; ++k)
+                renameOperand(&in->args[k]);
+            if (in->op == IrMove && in->dst.kind == IrTemp && in->a.kind == IrTemp &&
+                in->dst.value == in->a.value)
+                ir_remove(b, in);
+        }
+    }
+}
+
+static void countAccess(int temp, void* count)
+{
+    ++((int*)count)[temp];
+}
+
+/* Function firstRead returns the operand the
+ * instruction in reads first: a call stores its
+ * arguments from the last
+ */
+static IrOperand firstRead(IrInstr in)
+{
+    if (in->op == IrCall && in->argCount > 0)
+        return in->args[in->argCount - 1];
+    return in->a;
+}
+
+/* Procedure passInAc leaves in ac the temps that
+ * are written once and read once, by the next
+ * instruction, as the operand it reads first.
+ * They need no register
+ */
+static void passInAc(int* reg)
+{
+    int* reads = (int*)allocOrDie((n + 1) * sizeof(int));
+    int* writes = (int*)allocOrDie((n + 1) * sizeof(int));
+    IrInstr in, next;
+    int i, t;
+    for (i = 0; i < function->blockCount; ++i)
+    {
+        for (in = function->blocks[i]->first; in != NULL; in = in->next)
+        {
+            forUses(in, countAccess, reads);
+            if (in->dst.kind == IrTemp)
+                ++writes[in->dst.value];
+        }
+    }
+    for (i = 0; i < function->blockCount; ++i)
+    {
+        for (in = function->blocks[i]->first; in != NULL; in = in->next)
+        {
+            next = in->next;
+            if (in->dst.kind != IrTemp || in->op == IrParam || next == NULL)
+                continue;
+            t = in->dst.value;
+            if (writes[t] == 1 && reads[t] == 1 && firstRead(next).kind == IrTemp &&
+                firstRead(next).value == t)
+                reg[t] = ac;
+        }
+    }
+    free(reads);
+    free(writes);
+}
+
+/* Procedure color colors the temps that are read
+ * with the registers, or MEMORY. A temp costing
+ * more to save around calls than to keep in memory
+ * stays there. Temps of fewer than K neighbors are
+ * removed from the graph until none is left; when
+ * all have K or more, the one of least weight per
+ * neighbor goes and may still find a register
+ */
+static void color(int* reg)
+{
+    int* stack = (int*)allocOrDie((n + 1) * sizeof(int));
+    char* removed = (char*)allocOrDie(n + 1);
+    IntList low = { NULL, 0, 0 };
+    int top = 0, left = 0, t, j;
+    for (t = 0; t < n; ++t)
+    {
+        degree[t] = 0;
+        removed[t] = TRUE;
+        if (find(t) != t || reg[t] == ac)
+            continue;
+        if (useCount[t] > 0 && callCost[t] >= weight[t])
+            reg[t] = MEMORY;
+        else if (useCount[t] > 0)
+        {
+            removed[t] = FALSE;
+            ++left;
+        }
+    }
+    /* the neighbors of a temp may repeat after merges */
+    for (t = 0; t < n; ++t)
+    {
+        if (removed[t])
+            continue;
+        ++stamp;
+        for (j = 0; j < adj[t].count; ++j)
+        {
+            int m = find(adj[t].items[j]);
+            if (!removed[m] && seen[m] != stamp)
+            {
+                seen[m] = stamp;
+                ++degree[t];
+            }
+        }
+        if (degree[t] < K)
+            append(&low, t);
+    }
+    while (left > 0)
+    {
+        if (low.count > 0)
+            t = low.items[--low.count];
+        else
+        {
+            int best = -1;
+            for (t = 0; t < n; ++t)
+                if (!removed[t] && (best < 0 || weight[t] * degree[best] < weight[best] * degree[t]))
+                    best = t;
+            t = best;
+        }
+        if (removed[t])
+            continue;
+        removed[t] = TRUE;
+        --left;
+        stack[top++] = t;
+        ++stamp;
+        for (j = 0; j < adj[t].count; ++j)
+        {
+            int m = find(adj[t].items[j]);
+            if (removed[m] || seen[m] == stamp)
+                continue;
+            seen[m] = stamp;
+            if (--degree[m] == K - 1)
+                append(&low, m);
+        }
+    }
+    while (top > 0)
+    {
+        int used = 0, r;
+        t = stack[--top];
+        for (j = 0; j < adj[t].count; ++j)
+        {
+            int m = find(adj[t].items[j]);
+            if (reg[m] >= FIRSTTEMP)
+                used |= 1 << reg[m];
+        }
+        reg[t] = MEMORY;
+        for (r = FIRSTTEMP; r <= LASTTEMP; ++r)
+        {
+            if (!(used & (1 << r)))
+            {
+                reg[t] = r;
+                break;
+            }
+        }
+    }
+    free(stack);
+    free(removed);
+    free(low.items);
+}
+
+/* Procedure markSaves sets the registers every
+ * call saves: those of the temps live across it
+ */
+static void markSaves(int* reg)
+{
+    Word* liveOut = findLiveOut();
+    Word* live = (Word*)allocOrDie(words * sizeof(Word));
+    IrInstr in;
+    int i, t;
+    for (i = 0; i < function->blockCount; ++i)
+    {
+        memcpy(live, liveOut + (size_t)i * words, words * sizeof(Word));
+        for (in = function->blocks[i]->last; in != NULL; in = in->prev)
+        {
+            if (in->dst.kind == IrTemp)
+                clearBit(live, in->dst.value);
+            if (in->op == IrCall)
+            {
+                in->saves = 0;
+                for (t = nextMember(live, 0); t >= 0; t = nextMember(live, t + 1))
+                    if (reg[t] >= FIRSTTEMP)
+                        in->saves |= 1 << reg[t];
+            }
+            forUses(in, setBit, live);
+        }
+    }
+    free(live);
+    free(liveOut);
+}
+
+int* ra_allocate(IrFunction f)
+{
+    int* reg;
+    Word* liveOut;
+    int t;
+    function = f;
+    n = f->tempCount;
+    words = (n + WORDBITS - 1) / WORDBITS;
+    reg = (int*)allocOrDie((n + 1) * sizeof(int));
+    weight = (long*)allocOrDie((n + 1) * sizeof(long));
+    callCost = (long*)allocOrDie((n + 1) * sizeof(long));
+    useCount = (int*)allocOrDie((n + 1) * sizeof(int));
+    countUses();
+    if (n > MAXTEMPS || (long)f->blockCount * words * WORDBITS > MAXSETBITS)
+    {
+        for (t = 0; t < n; ++t)
+            reg[t] = useCount[t] > 0 ? MEMORY : NOWHERE;
+        free(weight);
+        free(callCost);
+        free(useCount);
+        return reg;
+    }
+    matrix = (Word*)allocOrDie(((long)n * n / 2 / WORDBITS + 1) * sizeof(Word));
+    adj = (IntList*)allocOrDie((n + 1) * sizeof(IntList));
+    alias = (int*)allocOrDie((n + 1) * sizeof(int));
+    degree = (int*)allocOrDie((n + 1) * sizeof(int));
+    seen = (int*)allocOrDie((n + 1) * sizeof(int));
+    stamp = 0;
+    for (t = 0; t < n; ++t)
+    {
+        alias[t] = t;
+        reg[t] = NOWHERE;
+    }
+    liveOut = findLiveOut();
+    buildGraph(liveOut);
+    free(liveOut);
+    coalesce();
+    passInAc(reg);
+    color(reg);
+    for (t = 0; t < n; ++t)
+        reg[t] = reg[find(t)];
+    markSaves(reg);
+    for (t = 0; t < n; ++t)
+        free(adj[t].items);
+    free(matrix);
+    free(adj);
+    free(alias);
+    free(degree);
+    free(seen);
+    free(weight);
+    free(callCost);
+    free(useCount);
+    return reg;
+}
+
+/* the interval of positions over which every temp
+ * kept in memory is live, for ra_assign_slots; a
+ * read at instruction i is at 2i and a write at
+ * 2i + 1, so a temp written by the instruction that
+ * reads another last may take its slot
+ */
+static int* firstPos;
+static int* lastPos;
+static int position;
+
+/* Procedure widen extends the interval of t to
+ * cover pos
+ */
+static void widen(int t, int pos)
+{
+    if (pos < firstPos[t])
+        firstPos[t] = pos;
+    if (pos > lastPos[t])
+        lastPos[t] = pos;
+}
+
+static void markRead(int temp, void* reg)
+{
+    if (((int*)reg)[temp] == MEMORY)
+        widen(temp, position);
+}
+
+static int byFirst(const void* a, const void* b)
+{
+    int x = *(const int*)a, y = *(const int*)b;
+    if (firstPos[x] != firstPos[y])
+        return firstPos[x] < firstPos[y] ? -1 : 1;
+    return x - y;
+}
+
+/* Procedure findIntervals sets the interval of
+ * every temp of f kept in memory by reg. A temp live on a
+ * jump back in the layout is live from its target
+ * to the jump. Parameters are left out
+ */
+static void findIntervals(IrFunction f, int* reg)
+{
+    int blocks = f->blockCount;
+    int* start = (int*)allocOrDie((blocks + 1) * sizeof(int));
+    int* end = (int*)allocOrDie((blocks + 1) * sizeof(int));
+    IrInstr in;
+    int i, s, t, changed = TRUE;
+    position = 0;
+    for (i = 0; i < blocks; ++i)
+    {
+        start[i] = position;
+        for (in = f->blocks[i]->first; in != NULL; in = in->next)
+        {
+            forUses(in, markRead, reg);
+            if (in->dst.kind == IrTemp && reg[in->dst.value] == MEMORY)
+            {
+                if (in->op == IrParam)
+                    firstPos[in->dst.value] = -1;
+                else
+                    widen(in->dst.value, position + 1);
+            }
+            position += 2;
+        }
+        end[i] = position - 1;
+    }
+    while (changed)
+    {
+        changed = FALSE;
+        for (i = 0; i < blocks; ++i)
+        {
+            for (s = 0; s < f->blocks[i]->succCount; ++s)
+            {
+                int h = start[f->blocks[i]->succ[s]->id];
+                if (h > end[i])
+                    continue;
+                for (t = 0; t < f->tempCount; ++t)
+                {
+                    if (firstPos[t] < 0 || lastPos[t] < h || firstPos[t] > end[i] ||
+                        (firstPos[t] <= h && lastPos[t] >= end[i]))
+                        continue;
+                    widen(t, h);
+                    widen(t, end[i]);
+                    changed = TRUE;
+                }
+            }
+        }
+    }
+    free(start);
+    free(end);
+}
+
+int ra_assign_slots(IrFunction f, int* reg, int* spill)
+{
+    int* order = (int*)allocOrDie((f->tempCount + 1) * sizeof(int));
+    IntList slotEnd = { NULL, 0, 0 };
+    int i, t, k, count = 0;
+    firstPos = (int*)allocOrDie((f->tempCount + 1) * sizeof(int));
+    lastPos = (int*)allocOrDie((f->tempCount + 1) * sizeof(int));
+    for (t = 0; t < f->tempCount; ++t)
+    {
+        spill[t] = -1;
+        firstPos[t] = INT_MAX;
+        lastPos[t] = -1;
+    }
+    findIntervals(f, reg);
+    for (t = 0; t < f->tempCount; ++t)
+        if (firstPos[t] >= 0 && lastPos[t] >= 0)
+            order[count++] = t;
+    /* a temp takes the first slot free at its start */
+    qsort(order, count, sizeof(int), byFirst);
+    for (i = 0; i < count; ++i)
+    {
+        t = order[i];
+        for (k = 0; k < slotEnd.count && slotEnd.items[k] >= firstPos[t]; ++k)
+            ;
+        if (k == slotEnd.count)
+            append(&slotEnd, lastPos[t]);
+        else
+            slotEnd.items[k] = lastPos[t];
+        spill[t] = k;
+    }
+    count = slotEnd.count;
+    free(slotEnd.items);
+    free(firstPos);
+    free(lastPos);
+    free(order);
+    return count;
+}
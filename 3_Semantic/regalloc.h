@@ -0,0 +1,40 @@
+/****************************************************/
+/* File: regalloc.h                                 */
+/* Register allocation interface for the C-Minus    */
+/* compiler                                         */
+/****************************************************/
+
+#ifndef _REGALLOC_H_
+#define _REGALLOC_H_
+
+#include "ir.h"
+
+/* NOWHERE is the location of a temp that is never
+ * read, and MEMORY that of a temp kept in a slot of
+ * the frame
+ */
+#define NOWHERE (-2)
+#define MEMORY (-1)
+
+/* Function ra_allocate gives every temp of f, out
+ * of SSA form, a register FIRSTTEMP..LASTTEMP or a
+ * location MEMORY or NOWHERE; a temp read only by
+ * the next instruction may be left in ac. Moves
+ * between temps that can share a register are
+ * removed and their temps merged. Registers are
+ * saved by the caller: every call is given the
+ * registers it must save. The returned array is
+ * indexed by temp
+ */
+int* ra_allocate(IrFunction f);
+
+/* Function ra_assign_slots gives every temp of f
+ * kept in MEMORY by reg, but parameters, which stay
+ * in their own slots, a spill slot from 0 up; temps
+ * never live at the same time share one. It sets
+ * spill[t] to the slot of t, or -1, and returns the
+ * number of slots
+ */
+int ra_assign_slots(IrFunction f, int* reg, int* spill);
+
+#endif
@@ -19,4 +19,10 @@ extern char tokenString[MAXTOKENLEN + 1];
  */
 TokenType getToken(void);
 
+/* Procedure resetScanner makes getToken start over
+ * at the first line of source, so that a run can
+ * parse more than one file
+ */
+void resetScanner(void);
+
 #endif
@@ -40,5 +40,20 @@ def main():
             
             print(f"테스트 성공: {case}\n  {s}\n")
 
+    # the other ways to analyze must report what the default one does
+    paths = ['./test_case_s/' + str(case) for case in sorted(success_cases)] + \
+            ['./test_case_e/' + str(case) for case in sorted(failure_cases)]
+    for path in paths:
+        case = os.path.basename(path)
+        proc = subprocess.run(['./cminus_semantic', path], capture_output=True)
+        want = proc.stdout.decode('utf-8')
+        for mode in ['--jobs=4', '--stream', '--single-pass']:
+            proc = subprocess.run(['./cminus_semantic', mode, path], capture_output=True)
+            r = proc.stdout.decode('utf-8')
+            if r != want:
+                print(f'테스트 실패: {case} ({mode}) \n{r}\n')
+            else:
+                print(f"테스트 성공: {case} ({mode})")
+
 if __name__ == '__main__':
     main()
\ No newline at end of file
@@ -0,0 +1,885 @@
+/****************************************************/
+/* File: ssa.c                                      */
+/* Construction and destruction of the SSA form of  */
+/* the intermediate code of the C-Minus compiler    */
+/* Dominators are found with the algorithm of       */
+/* Cooper, Harvey and Kennedy, phis are placed on   */
+/* the iterated dominance frontiers of Cytron et al */
+/****************************************************/
+
+#include <limits.h>
+#include "globals.h"
+#include "ir.h"
+
+static void* allocOrDie(size_t size)
+{
+    void* p = calloc(1, size);
+    if (p == NULL)
+    {
+        fprintf(listing, "Out of memory error at line %d\n", lineno);
+        exit(1);
+    }
+    return p;
+}
+
+static void* growOrDie(void* array, int* capacity, size_t size)
+{
+    *capacity = *capacity ? 2 * *capacity : 8;
+    array = realloc(array, *capacity * size);
+    if (array == NULL)
+    {
+        fprintf(listing, "Out of memory error at line %d\n", lineno);
+        exit(1);
+    }
+    return array;
+}
+
+/* a growable list of integers */
+typedef struct
+{
+    int* items;
+    int count;
+    int capacity;
+} IntList;
+
+static void append(IntList* list, int item)
+{
+    if (list->count == list->capacity)
+        list->items = growOrDie(list->items, &list->capacity, sizeof(int));
+    list->items[list->count++] = item;
+}
+
+/* Procedure removeUnreachable removes the blocks of
+ * f that the entry does not reach, and the phi
+ * arguments that come from them
+ */
+static void removeUnreachable(IrFunction f)
+{
+    char* reached = (char*)allocOrDie(f->blockCount);
+    IrBlock* stack = (IrBlock*)allocOrDie(f->blockCount * sizeof(IrBlock));
+    IrInstr in, next;
+    int top = 0, i, j, p, kept;
+    reached[0] = TRUE;
+    stack[top++] = f->blocks[0];
+    while (top > 0)
+    {
+        IrBlock b = stack[--top];
+        for (i = 0; i < b->succCount; ++i)
+        {
+            if (!reached[b->succ[i]->id])
+            {
+                reached[b->succ[i]->id] = TRUE;
+                stack[top++] = b->succ[i];
+            }
+        }
+    }
+    for (i = 0; i < f->blockCount; ++i)
+    {
+        IrBlock b = f->blocks[i];
+        if (!reached[i])
+            continue;
+        for (p = kept = 0; p < b->predCount; ++p)
+        {
+            if (!reached[b->pred[p]->id])
+                continue;
+            for (in = b->first; in != NULL && in->op == IrPhi; in = in->next)
+                in->args[kept] = in->args[p];
+            b->pred[kept++] = b->pred[p];
+        }
+        for (in = b->first; in != NULL && in->op == IrPhi; in = in->next)
+            in->argCount = kept;
+        b->predCount = kept;
+    }
+    for (i = j = 0; i < f->blockCount; ++i)
+    {
+        IrBlock b = f->blocks[i];
+        if (reached[i])
+        {
+            f->blocks[j++] = b;
+            continue;
+        }
+        for (in = b->first; in != NULL; in = next)
+        {
+            next = in->next;
+            free(in->args);
+            free(in);
+        }
+        free(b->pred);
+        free(b);
+    }
+    f->blockCount = j;
+    for (i = 0; i < f->blockCount; ++i)
+        f->blocks[i]->id = i;
+    free(reached);
+    free(stack);
+}
+
+/* Function reversePostorder returns the blocks of f
+ * in reverse postorder and sets their order
+ */
+static IrBlock* reversePostorder(IrFunction f)
+{
+    IrBlock* order = (IrBlock*)allocOrDie(f->blockCount * sizeof(IrBlock));
+    IrBlock* stack = (IrBlock*)allocOrDie(f->blockCount * sizeof(IrBlock));
+    int* nextSucc = (int*)allocOrDie(f->blockCount * sizeof(int));
+    char* seen = (char*)allocOrDie(f->blockCount);
+    int top = 0, n = f->blockCount;
+    stack[top++] = f->blocks[0];
+    seen[0] = TRUE;
+    while (top > 0)
+    {
+        IrBlock b = stack[top - 1];
+        if (nextSucc[b->id] < b->succCount)
+        {
+            IrBlock s = b->succ[nextSucc[b->id]++];
+            if (!seen[s->id])
+            {
+                seen[s->id] = TRUE;
+                stack[top++] = s;
+            }
+            continue;
+        }
+        --top;
+        b->order = --n;
+        order[n] = b;
+    }
+    free(stack);
+    free(nextSucc);
+    free(seen);
+    return order;
+}
+
+static IrBlock intersect(IrBlock a, IrBlock b)
+{
+    while (a != b)
+    {
+        while (a->order > b->order)
+            a = a->idom;
+        while (b->order > a->order)
+            b = b->idom;
+    }
+    return a;
+}
+
+/* Procedure findDominators sets the immediate
+ * dominator of every block of f, taken in the
+ * reverse postorder order
+ */
+static void findDominators(IrFunction f, IrBlock* order)
+{
+    int changed = TRUE, i, p;
+    for (i = 0; i < f->blockCount; ++i)
+        f->blocks[i]->idom = NULL;
+    order[0]->idom = order[0];
+    while (changed)
+    {
+        changed = FALSE;
+        for (i = 1; i < f->blockCount; ++i)
+        {
+            IrBlock b = order[i], idom = NULL;
+            for (p = 0; p < b->predCount; ++p)
+            {
+                if (b->pred[p]->idom == NULL)
+                    continue;
+                idom = idom == NULL ? b->pred[p] : intersect(b->pred[p], idom);
+            }
+            if (idom != b->idom)
+            {
+                b->idom = idom;
+                changed = TRUE;
+            }
+        }
+    }
+}
+
+/* the SSA construction of a function */
+static IrFunction function;
+static IntList* frontier; /* dominance frontier, by block */
+static IntList* children; /* in the dominator tree, by block */
+static int** stacks;      /* current temp of each variable */
+static int* stackSizes;
+static int* stackCapacities;
+
+/* Procedure findFrontiers sets the dominance
+ * frontier and the dominator tree children of
+ * every block
+ */
+static void findFrontiers(IrFunction f)
+{
+    int i, p;
+    frontier = (IntList*)allocOrDie(f->blockCount * sizeof(IntList));
+    children = (IntList*)allocOrDie(f->blockCount * sizeof(IntList));
+    for (i = 0; i < f->blockCount; ++i)
+    {
+        IrBlock b = f->blocks[i];
+        if (i > 0)
+            append(&children[b->idom->id], i);
+        if (b->predCount < 2)
+            continue;
+        for (p = 0; p < b->predCount; ++p)
+        {
+            IrBlock runner = b->pred[p];
+            while (runner != b->idom)
+            {
+                IntList* df = &frontier[runner->id];
+                if (df->count == 0 || df->items[df->count - 1] != i)
+                    append(df, i);
+                runner = runner->idom;
+            }
+        }
+    }
+}
+
+/* Procedure placePhis inserts a phi for every
+ * variable at the iterated dominance frontier of
+ * its assignments. Only variables read in a block
+ * they are not assigned before get phis
+ */
+static void placePhis(IrFunction f)
+{
+    IntList* defs = (IntList*)allocOrDie((f->varCount + 1) * sizeof(IntList));
+    char* crosses = (char*)allocOrDie(f->varCount + 1);
+    int* assigned = (int*)allocOrDie((f->varCount + 1) * sizeof(int));
+    int* hasPhi = (int*)allocOrDie(f->blockCount * sizeof(int));
+    int* inWork = (int*)allocOrDie(f->blockCount * sizeof(int));
+    IntList work = { NULL, 0, 0 };
+    IrInstr in;
+    int i, v, k;
+    for (i = 0; i < f->blockCount; ++i)
+    {
+        for (in = f->blocks[i]->first; in != NULL; in = in->next)
+        {
+            IrOperand* uses[2];
+            uses[0] = &in->a;
+            uses[1] = &in->b;
+            for (k = 0; k < 2; ++k)
+                if (uses[k]->kind == IrVar && assigned[uses[k]->value] != i + 1)
+                    crosses[uses[k]->value] = TRUE;
+            for (k = 0; k < in->argCount; ++k)
+                if (in->args[k].kind == IrVar && assigned[in->args[k].value] != i + 1)
+                    crosses[in->args[k].value] = TRUE;
+            if (in->dst.kind == IrVar)
+            {
+                v = in->dst.value;
+                if (assigned[v] != i + 1)
+                    append(&defs[v], i);
+                assigned[v] = i + 1;
+            }
+        }
+    }
+    for (v = 0; v < f->varCount; ++v)
+    {
+        if (!crosses[v])
+            continue;
+        work.count = 0;
+        for (k = 0; k < defs[v].count; ++k)
+        {
+            append(&work, defs[v].items[k]);
+            inWork[defs[v].items[k]] = v + 1;
+        }
+        while (work.count > 0)
+        {
+            IntList* df = &frontier[work.items[--work.count]];
+            for (k = 0; k < df->count; ++k)
+            {
+                IrBlock d = f->blocks[df->items[k]];
+                if (hasPhi[d->id] == v + 1)
+                    continue;
+                hasPhi[d->id] = v + 1;
+                in = ir_new_instr(IrPhi, d->first != NULL ? d->first->lineno : 0);
+                in->dst.kind = IrVar;
+                in->dst.value = v;
+                in->argCount = d->predCount;
+                in->args = (IrOperand*)allocOrDie(d->predCount * sizeof(IrOperand));
+                for (i = 0; i < d->predCount; ++i)
+                    in->args[i] = in->dst;
+                ir_insert_before(d, d->first, in);
+                if (inWork[d->id] != v + 1)
+                {
+                    inWork[d->id] = v + 1;
+                    append(&work, d->id);
+                }
+            }
+        }
+    }
+    for (v = 0; v < f->varCount; ++v)
+        free(defs[v].items);
+    free(defs);
+    free(crosses);
+    free(assigned);
+    free(hasPhi);
+    free(inWork);
+    free(work.items);
+}
+
+static void push(int v, int temp)
+{
+    if (stackSizes[v] == stackCapacities[v])
+        stacks[v] = growOrDie(stacks[v], &stackCapacities[v], sizeof(int));
+    stacks[v][stackSizes[v]++] = temp;
+}
+
+/* Procedure use replaces the variable o by its
+ * current temp. A variable read before any
+ * assignment reads 0
+ */
+static void use(IrOperand* o)
+{
+    int v = o->value;
+    if (o->kind != IrVar)
+        return;
+    if (stackSizes[v] == 0)
+    {
+        o->kind = IrConst;
+        o->value = 0;
+        return;
+    }
+    o->kind = IrTemp;
+    o->value = stacks[v][stackSizes[v] - 1];
+}
+
+/* Procedure renameBlock renames the variables of
+ * block b and fills in the phis of its successors,
+ * logging the variables it assigns
+ */
+static void renameBlock(IrBlock b, IntList* log)
+{
+    IrInstr in;
+    int i, s, p;
+    for (in = b->first; in != NULL; in = in->next)
+    {
+        if (in->op != IrPhi)
+        {
+            use(&in->a);
+            use(&in->b);
+            for (i = 0; i < in->argCount; ++i)
+                use(&in->args[i]);
+        }
+        if (in->dst.kind == IrVar)
+        {
+            int temp = ir_new_temp(function);
+            push(in->dst.value, temp);
+            append(log, in->dst.value);
+            in->dst.kind = IrTemp;
+            in->dst.value = temp;
+        }
+    }
+    for (s = 0; s < b->succCount; ++s)
+    {
+        IrBlock succ = b->succ[s];
+        for (p = 0; p < succ->predCount; ++p)
+        {
+            if (succ->pred[p] != b)
+                continue;
+            for (in = succ->first; in != NULL && in->op == IrPhi; in = in->next)
+                use(&in->args[p]);
+        }
+    }
+}
+
+/* Procedure renameVars renames the variables of f into
+ * temps, walking the dominator tree with an explicit
+ * stack. A block's entry in the stack is its number
+ * plus one while its children remain, and minus the
+ * height of the log when it was entered once they
+ * are done
+ */
+static void renameVars(IrFunction f)
+{
+    IntList stack = { NULL, 0, 0 };
+    IntList log = { NULL, 0, 0 };
+    IntList marks = { NULL, 0, 0 };
+    int v;
+    int* nextChild = (int*)allocOrDie(f->blockCount * sizeof(int));
+    stacks = (int**)allocOrDie((f->varCount + 1) * sizeof(int*));
+    stackSizes = (int*)allocOrDie((f->varCount + 1) * sizeof(int));
+    stackCapacities = (int*)allocOrDie((f->varCount + 1) * sizeof(int));
+    append(&stack, 0);
+    append(&marks, 0);
+    renameBlock(f->blocks[0], &log);
+    while (stack.count > 0)
+    {
+        int b = stack.items[stack.count - 1];
+        if (nextChild[b] < children[b].count)
+        {
+            int c = children[b].items[nextChild[b]++];
+            append(&stack, c);
+            append(&marks, log.count);
+            renameBlock(f->blocks[c], &log);
+            continue;
+        }
+        /* the block is done: forget its assignments */
+        while (log.count > marks.items[marks.count - 1])
+            --stackSizes[log.items[--log.count]];
+        --stack.count;
+        --marks.count;
+    }
+    for (v = 0; v < f->varCount; ++v)
+        free(stacks[v]);
+    free(stacks);
+    free(stackSizes);
+    free(stackCapacities);
+    free(nextChild);
+    free(stack.items);
+    free(log.items);
+    free(marks.items);
+}
+
+/* Procedure markUses marks the temps in read
+ * live, adding those newly marked to work
+ */
+static void markUses(IrInstr in, char* live, IntList* work)
+{
+    IrOperand* uses[2];
+    int k;
+    uses[0] = &in->a;
+    uses[1] = &in->b;
+    for (k = 0; k < 2; ++k)
+    {
+        if (uses[k]->kind == IrTemp && !live[uses[k]->value])
+        {
+            live[uses[k]->value] = TRUE;
+            append(work, uses[k]->value);
+        }
+    }
+    for (k = 0; k < in->argCount; ++k)
+    {
+        if (in->args[k].kind == IrTemp && !live[in->args[k].value])
+        {
+            live[in->args[k].value] = TRUE;
+            append(work, in->args[k].value);
+        }
+    }
+}
+
+static int isRemovable(IrInstr in)
+{
+    return ir_is_pure(in) && in->dst.kind == IrTemp;
+}
+
+/* Procedure sweep removes the pure instructions of
+ * f whose results are not used, even by one another
+ */
+static void sweep(IrFunction f)
+{
+    IrInstr* def = (IrInstr*)allocOrDie((f->tempCount + 1) * sizeof(IrInstr));
+    char* live = (char*)allocOrDie(f->tempCount + 1);
+    IntList work = { NULL, 0, 0 };
+    IrInstr in, next;
+    int i;
+    for (i = 0; i < f->blockCount; ++i)
+    {
+        for (in = f->blocks[i]->first; in != NULL; in = in->next)
+        {
+            if (in->dst.kind == IrTemp)
+                def[in->dst.value] = in;
+            if (!isRemovable(in))
+                markUses(in, live, &work);
+        }
+    }
+    while (work.count > 0)
+    {
+        in = def[work.items[--work.count]];
+        if (in != NULL)
+            markUses(in, live, &work);
+    }
+    for (i = 0; i < f->blockCount; ++i)
+    {
+        for (in = f->blocks[i]->first; in != NULL; in = next)
+        {
+            next = in->next;
+            if (isRemovable(in) && !live[in->dst.value])
+                ir_remove(f->blocks[i], in);
+        }
+    }
+    free(def);
+    free(live);
+    free(work.items);
+}
+
+/************************************************/
+/* constant and copy propagation                */
+/************************************************/
+
+/* replacement[t] is the operand that replaces the
+ * temp t, or IrNone
+ */
+static IrOperand* replacement;
+
+static IrOperand resolve(IrOperand o)
+{
+    while (o.kind == IrTemp && replacement[o.value].kind != IrNone)
+        o = replacement[o.value];
+    return o;
+}
+
+/* Function substitute replaces *o by what replaces
+ * it and tells whether it changed
+ */
+static int substitute(IrOperand* o)
+{
+    IrOperand r = resolve(*o);
+    if (r.kind == o->kind && r.value == o->value)
+        return FALSE;
+    *o = r;
+    return TRUE;
+}
+
+static int isConst(IrOperand o, int val)
+{
+    return o.kind == IrConst && o.value == val;
+}
+
+/* Function evaluate computes a op b into *val and
+ * returns FALSE if it must be left to run time, as
+ * a division by 0. Arithmetic wraps around as in
+ * the TM
+ */
+static int evaluate(IrOpcode op, int a, int b, int* val)
+{
+    switch (op)
+    {
+        case IrAdd:
+            *val = (int)((unsigned)a + (unsigned)b);
+            return TRUE;
+        case IrSub:
+            *val = (int)((unsigned)a - (unsigned)b);
+            return TRUE;
+        case IrMul:
+            *val = (int)((unsigned)a * (unsigned)b);
+            return TRUE;
+        case IrDiv:
+            if (b == 0 || (b == -1 && a == INT_MIN))
+                return FALSE;
+            *val = a / b;
+            return TRUE;
+        case IrLt:
+            *val = a < b;
+            return TRUE;
+        case IrLe:
+            *val = a <= b;
+            return TRUE;
+        case IrGt:
+            *val = a > b;
+            return TRUE;
+        case IrGe:
+            *val = a >= b;
+            return TRUE;
+        case IrEq:
+            *val = a == b;
+            return TRUE;
+        case IrNe:
+            *val = a != b;
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+/* Function valueOf sets *o to the operand the
+ * result of in always equals, and tells whether
+ * there is one: the source of a move, the one
+ * argument of a phi but for the phi itself, a
+ * constant result or an identity
+ */
+static int valueOf(IrInstr in, IrOperand* o)
+{
+    int i, val;
+    o->kind = IrConst;
+    switch (in->op)
+    {
+        case IrMove:
+            *o = in->a;
+            return TRUE;
+        case IrPhi:
+            o->kind = IrNone;
+            for (i = 0; i < in->argCount; ++i)
+            {
+                if (in->args[i].kind == IrTemp && in->args[i].value == in->dst.value)
+                    continue;
+                if (o->kind != IrNone && (o->kind != in->args[i].kind || o->value != in->args[i].value))
+                    return FALSE;
+                *o = in->args[i];
+            }
+            return o->kind != IrNone;
+        case IrAdd:
+        case IrSub:
+        case IrMul:
+        case IrDiv:
+        case IrLt:
+        case IrLe:
+        case IrGt:
+        case IrGe:
+        case IrEq:
+        case IrNe:
+            if (in->a.kind == IrConst && in->b.kind == IrConst &&
+                evaluate(in->op, in->a.value, in->b.value, &val))
+            {
+                o->value = val;
+                return TRUE;
+            }
+            if ((in->op == IrAdd || in->op == IrSub) && isConst(in->b, 0))
+            {
+                *o = in->a;
+                return TRUE;
+            }
+            if ((in->op == IrMul || in->op == IrDiv) && isConst(in->b, 1))
+            {
+                *o = in->a;
+                return TRUE;
+            }
+            o->value = 0;
+            if (in->op == IrMul && isConst(in->b, 0))
+                return TRUE;
+            return in->op == IrSub && in->a.kind == IrTemp && in->b.kind == IrTemp &&
+                   in->a.value == in->b.value;
+        default:
+            return FALSE;
+    }
+}
+
+/* Procedure removePred removes the edge from p to
+ * b, and the phi arguments that come along it
+ */
+static void removePred(IrBlock b, IrBlock p)
+{
+    IrInstr in;
+    int k, i;
+    for (k = 0; k < b->predCount && b->pred[k] != p; ++k)
+        ;
+    if (k == b->predCount)
+        return;
+    for (i = k + 1; i < b->predCount; ++i)
+        b->pred[i - 1] = b->pred[i];
+    --b->predCount;
+    for (in = b->first; in != NULL && in->op == IrPhi; in = in->next)
+    {
+        for (i = k + 1; i < in->argCount; ++i)
+            in->args[i - 1] = in->args[i];
+        --in->argCount;
+    }
+}
+
+/* Function foldBranch turns the branch in ending
+ * block b into a jump if its operands are
+ * constants, and tells whether it did
+ */
+static int foldBranch(IrBlock b, IrInstr in)
+{
+    IrBlock taken, dropped;
+    int val;
+    if (in->a.kind != IrConst || in->b.kind != IrConst ||
+        !evaluate(in->relation, in->a.value, in->b.value, &val))
+        return FALSE;
+    taken = b->succ[val ? 0 : 1];
+    dropped = b->succ[val ? 1 : 0];
+    removePred(dropped, b);
+    in->op = IrJump;
+    in->a.kind = in->b.kind = IrNone;
+    b->succ[0] = taken;
+    b->succCount = 1;
+    return TRUE;
+}
+
+/* Procedure propagate replaces the temps of f that
+ * always equal a constant or another temp by it,
+ * until no more are found, and removes the branches
+ * that constants decide with the code they leave
+ * unreachable. A phi is replaced only if all its
+ * arguments agree, so a loop keeps the value its
+ * body may change
+ */
+static void propagate(IrFunction f)
+{
+    IrInstr in, next;
+    IrOperand o;
+    int changed = TRUE, folded, i, k;
+    replacement = (IrOperand*)allocOrDie((f->tempCount + 1) * sizeof(IrOperand));
+    while (changed)
+    {
+        changed = folded = FALSE;
+        for (i = 0; i < f->blockCount; ++i)
+        {
+            IrBlock b = f->blocks[i];
+            for (in = b->first; in != NULL; in = next)
+            {
+                next = in->next;
+                changed |= substitute(&in->a);
+                changed |= substitute(&in->b);
+                for (k = 0; k < in->argCount; ++k)
+                    changed |= substitute(&in->args[k]);
+                ir_order_operands(in);
+                if (in->op == IrBranch && foldBranch(b, in))
+                    folded = TRUE;
+                if (in->dst.kind == IrTemp && valueOf(in, &o))
+                {
+                    replacement[in->dst.value] = resolve(o);
+                    ir_remove(b, in);
+                    changed = TRUE;
+                }
+            }
+        }
+        if (folded)
+        {
+            removeUnreachable(f);
+            changed = TRUE;
+        }
+    }
+    free(replacement);
+}
+
+void ir_to_ssa(IrProgram program)
+{
+    IrFunction f;
+    IrBlock* order;
+    int i;
+    for (f = program->functions; f != NULL; f = f->next)
+    {
+        function = f;
+        removeUnreachable(f);
+        order = reversePostorder(f);
+        findDominators(f, order);
+        findFrontiers(f);
+        placePhis(f);
+        renameVars(f);
+        for (i = 0; i < f->blockCount; ++i)
+        {
+            free(frontier[i].items);
+            free(children[i].items);
+        }
+        free(frontier);
+        free(children);
+        free(order);
+        propagate(f);
+        sweep(f);
+    }
+}
+
+/************************************************/
+/* leaving SSA form                             */
+/************************************************/
+
+/* Procedure splitEdge puts a new block on the edge
+ * from the pred number p of b to b, right before b
+ */
+static void splitEdge(IrFunction f, IrBlock b, int p)
+{
+    IrBlock from = b->pred[p];
+    IrBlock m = ir_new_block(from->depth < b->depth ? from->depth : b->depth);
+    IrInstr jump = ir_new_instr(IrJump, from->last->lineno);
+    int s;
+    ir_insert_before(m, NULL, jump);
+    m->succ[0] = b;
+    m->succCount = 1;
+    ir_add_pred(m, from);
+    for (s = 0; s < from->succCount; ++s)
+        if (from->succ[s] == b)
+        {
+            from->succ[s] = m;
+            break;
+        }
+    b->pred[p] = m;
+    ir_place_block(f, m, b->id);
+}
+
+static int sameOperand(IrOperand a, IrOperand b)
+{
+    return a.kind == b.kind && a.value == b.value;
+}
+
+/* Procedure emitCopies inserts the parallel copy
+ * dst[i] = src[i], i < n, before the instruction
+ * before of block b as a sequence of moves. A copy
+ * goes once no other copy reads its destination;
+ * a cycle is broken through a new temp
+ */
+static void emitCopies(IrFunction f, IrBlock b, IrInstr before, IrOperand* dst, IrOperand* src, int n)
+{
+    IrInstr in;
+    int i, j, done;
+    while (n > 0)
+    {
+        done = FALSE;
+        for (i = 0; i < n && !done; ++i)
+        {
+            if (sameOperand(dst[i], src[i]))
+                done = TRUE;
+            else
+            {
+                for (j = 0; j < n; ++j)
+                    if (j != i && sameOperand(src[j], dst[i]))
+                        break;
+                if (j < n)
+                    continue;
+                done = TRUE;
+                in = ir_new_instr(IrMove, before->lineno);
+                in->dst = dst[i];
+                in->a = src[i];
+                ir_insert_before(b, before, in);
+            }
+            if (done)
+            {
+                dst[i] = dst[n - 1];
+                src[i] = src[n - 1];
+                --n;
+            }
+        }
+        if (done)
+            continue;
+        /* every destination is read by another copy */
+        in = ir_new_instr(IrMove, before->lineno);
+        in->dst.kind = IrTemp;
+        in->dst.value = ir_new_temp(f);
+        in->a = dst[0];
+        ir_insert_before(b, before, in);
+        for (j = 0; j < n; ++j)
+            if (sameOperand(src[j], dst[0]))
+                src[j] = in->dst;
+    }
+}
+
+void ir_from_ssa(IrProgram program)
+{
+    IrFunction f;
+    IrOperand *dst, *src;
+    IrInstr in, next;
+    int i, p, n;
+    for (f = program->functions; f != NULL; f = f->next)
+    {
+        for (i = 0; i < f->blockCount; ++i)
+        {
+            IrBlock b = f->blocks[i];
+            n = 0;
+            for (in = b->first; in != NULL && in->op == IrPhi; in = in->next)
+                ++n;
+            if (n == 0)
+                continue;
+            dst = (IrOperand*)allocOrDie(n * sizeof(IrOperand));
+            src = (IrOperand*)allocOrDie(n * sizeof(IrOperand));
+            for (p = 0; p < b->predCount; ++p)
+            {
+                IrBlock from = b->pred[p];
+                if (from->succCount > 1)
+                {
+                    splitEdge(f, b, p);
+                    ++i;
+                    from = b->pred[p];
+                }
+                n = 0;
+                for (in = b->first; in != NULL && in->op == IrPhi; in = in->next)
+                {
+                    dst[n] = in->dst;
+                    src[n++] = in->args[p];
+                }
+                emitCopies(f, from, from->last, dst, src, n);
+            }
+            for (in = b->first; in != NULL && in->op == IrPhi; in = next)
+            {
+                next = in->next;
+                ir_remove(b, in);
+            }
+            free(dst);
+            free(src);
+        }
+    }
+}
@@ -12,12 +12,151 @@
 #include <stdlib.h>
 #include <string.h>
 #include "symtab.h"
-#include "util.h"
 
 /* SHIFT is the power of two used as multiplier
    in hash function  */
 #define SHIFT 4
 
+/* xref = TRUE causes st_insert_lineno to record
+ * the line numbers of references
+ */
+static int xref = FALSE;
+
+void st_set_xref(int enabled)
+{
+    xref = enabled;
+}
+
+int st_xref_enabled(void)
+{
+    return xref;
+}
+
+/* stats = TRUE causes lookups to be counted for
+ * printSymtabStats
+ */
+static int stats = FALSE;
+
+typedef struct
+{
+    long count;
+    long probes;
+    long maxProbes;
+    long scopes;
+    long maxScopes;
+} ProbeStats;
+
+/* lookupStats counts the lookups of st_lookup,
+ * st_lookup_excluding_parent and st_resolve, and
+ * insertStats the ones st_insert and st_insert_lineno
+ * make while the table is built
+ */
+static ProbeStats lookupStats;
+static ProbeStats insertStats;
+
+void st_set_stats(int enabled)
+{
+    stats = enabled;
+    memset(&lookupStats, 0, sizeof(lookupStats));
+    memset(&insertStats, 0, sizeof(insertStats));
+}
+
+/* Procedure raiseMax sets *max to value if that is
+ * larger, also when other threads do the same
+ */
+static void raiseMax(long* max, long value)
+{
+    long old = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (value > old &&
+           !__atomic_compare_exchange_n(max, &old, value, FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+/* lookups may come from the type checking threads,
+ * so the counters are updated atomically
+ */
+static void countLookup(ProbeStats* counter, int probes, int scopes)
+{
+    __atomic_fetch_add(&counter->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&counter->probes, probes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&counter->scopes, scopes, __ATOMIC_RELAXED);
+    raiseMax(&counter->maxProbes, probes);
+    raiseMax(&counter->maxScopes, scopes);
+}
+
+void* st_alloc(ScopeTable table, size_t size, MemKind kind)
+{
+    mt_pool_add(table->memBytes, kind, (long)size);
+    return pool_alloc(table->pool, size);
+}
+
+char* st_strdup(ScopeTable table, const char* s, MemKind kind)
+{
+    mt_pool_add(table->memBytes, kind, (long)strlen(s) + 1);
+    return pool_strdup(table->pool, s);
+}
+
+/* Function st_grow resizes a block of kind from the
+ * pool of table like pool_grow and counts the bytes
+ * it grew by
+ */
+static void* st_grow(ScopeTable table, void* block, int* capacity, int size, MemKind kind)
+{
+    int old = *capacity;
+    block = pool_grow(table->pool, block, capacity, size);
+    mt_pool_add(table->memBytes, kind, *capacity - old);
+    return block;
+}
+
+/* Procedure lines_append appends lineno to lines as
+ * the zigzag-encoded varint of its distance from the
+ * previously appended line
+ */
+static void lines_append(ScopeTable table, LineList* lines, int lineno)
+{
+    int delta = lineno - lines->last;
+    unsigned int v = ((unsigned int)delta << 1) ^ (unsigned int)(delta >> 31);
+    if (lines->size + 5 > lines->capacity)
+    {
+        lines->bytes = (unsigned char*)st_grow(
+            table, lines->bytes, &lines->capacity, lines->size + 5, LineMem);
+    }
+    while (v >= 0x80)
+    {
+        lines->bytes[lines->size++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    lines->bytes[lines->size++] = (unsigned char)v;
+    lines->last = lineno;
+    ++lines->count;
+}
+
+void st_lines_begin(LineCursor* cursor, const LineList* lines)
+{
+    cursor->lines = lines;
+    cursor->pos = 0;
+    cursor->lineno = 0;
+}
+
+int st_lines_next(LineCursor* cursor)
+{
+    const LineList* lines = cursor->lines;
+    unsigned int v = 0;
+    int shift = 0;
+    if (cursor->pos >= lines->size)
+    {
+        return FALSE;
+    }
+    while (lines->bytes[cursor->pos] & 0x80)
+    {
+        v |= (unsigned int)(lines->bytes[cursor->pos++] & 0x7f) << shift;
+        shift += 7;
+    }
+    v |= (unsigned int)lines->bytes[cursor->pos++] << shift;
+    cursor->lineno += (int)(v >> 1) ^ -(int)(v & 1);
+    return TRUE;
+}
+
 /* the hash function */
 static int hash(char* key)
 {
@@ -31,66 +170,336 @@ static int hash(char* key)
     return temp;
 }
 
-ScopeList create_ScopeList(ScopeList parent, char* name)
+/* Procedure attachScope gives scope the next id of
+ * the table and appends it to its parent's children
+ */
+static void attachScope(ScopeTable table, ScopeList scope, ScopeList parent)
 {
-    ScopeList scope = (ScopeList)malloc(sizeof(struct ScopeListRec));
-    memset(scope, 0, sizeof(struct ScopeListRec));
-    scope->name = copyString(name);
+    if (table->count == table->capacity)
+    {
+        int bytes = table->capacity * (int)sizeof(ScopeList);
+        table->scopes = (ScopeList*)st_grow(
+            table, table->scopes, &bytes, bytes ? bytes * 2 : 16 * (int)sizeof(ScopeList), TableMem);
+        table->capacity = bytes / (int)sizeof(ScopeList);
+    }
+    scope->id = table->count;
+    table->scopes[table->count++] = scope;
+    scope->table = table;
+    scope->pool = table->pool;
     scope->parent = parent;
     if (parent)
     {
-        ScopeList* target = &parent->leftmost;
-        while (*target)
+        scope->depth = parent->depth + 1;
+        if (parent->rightmost)
         {
-            target = &(*target)->sibling;
+            parent->rightmost->sibling = scope;
         }
-        *target = scope;
+        else
+        {
+            parent->leftmost = scope;
+        }
+        parent->rightmost = scope;
+    }
+}
+
+static ScopeList newScope(ScopeList parent)
+{
+    ScopeTable table;
+    ScopeList scope;
+    if (parent)
+    {
+        table = parent->table;
     }
+    else
+    {
+        MemPool pool = pool_create();
+        table = (ScopeTable)pool_alloc(pool, sizeof(struct ScopeTableRec));
+        table->pool = pool;
+        mt_pool_add(table->memBytes, TableMem, sizeof(struct ScopeTableRec));
+        table->refcount = 1;
+        table->clean = TRUE;
+        table->xref = xref;
+    }
+    scope = (ScopeList)st_alloc(table, sizeof(struct ScopeListRec), ScopeMem);
+    attachScope(table, scope, parent);
+    return scope;
+}
+
+ScopeList create_ScopeList(ScopeList parent, char* name)
+{
+    ScopeList scope = newScope(parent);
+    scope->name = st_strdup(scope->table, name, SymbolNameMem);
+    return scope;
+}
+
+ScopeList create_BlockScope(ScopeList parent, int lineno)
+{
+    ScopeList scope = newScope(parent);
+    scope->lineno = lineno;
     return scope;
 }
 
+/* Procedure formatScopeName formats the name of
+ * scope, whose tree moved by shift lines
+ */
+static void formatScopeName(ScopeList scope, int shift, char* buf, int size)
+{
+    if ((scope->name != NULL && shift == 0) || scope->parent == NULL)
+    {
+        snprintf(buf, size, "%s", scope->name ? scope->name : "");
+    }
+    else
+    {
+        int n;
+        formatScopeName(scope->parent, shift, buf, size);
+        n = (int)strlen(buf);
+        snprintf(buf + n, size - n, "_%d", scope->lineno + shift);
+    }
+}
+
+void st_format_scope_name(ScopeList scope, char* buf, int size)
+{
+    formatScopeName(scope, 0, buf, size);
+}
+
+char* st_scope_name(ScopeList scope)
+{
+    if (scope->name == NULL)
+    {
+        char buf[101];
+        st_format_scope_name(scope, buf, 100);
+        scope->name = st_strdup(scope->table, buf, SymbolNameMem);
+    }
+    return scope->name;
+}
+
+/* Function scopeName returns the name of scope,
+ * whose tree moved by shift lines, formatting it in
+ * buf unless the tree stayed in place
+ */
+static char* scopeName(ScopeList scope, int shift, char* buf, int size)
+{
+    if (shift == 0)
+    {
+        return st_scope_name(scope);
+    }
+    formatScopeName(scope, shift, buf, size);
+    return buf;
+}
+
+/* Procedure releaseTable drops a reference to table
+ * and destroys its pool with the last one
+ */
+static void releaseTable(ScopeTable table)
+{
+    if (__atomic_sub_fetch(&table->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        mt_pool_release(table->memBytes);
+        pool_destroy(table->pool);
+    }
+}
+
+void st_destroy(ScopeList root)
+{
+    if (root)
+    {
+        releaseTable(root->table);
+    }
+}
+
+Symtab st_create(void)
+{
+    ScopeList global = create_ScopeList(NULL, "global");
+    Symtab tab = (Symtab)st_alloc(global->table, sizeof(struct SymtabRec), TableMem);
+    tab->refcount = 1;
+    tab->global = global;
+    return tab;
+}
+
+void st_add_unit(Symtab tab, ScopeTable unit, int shift)
+{
+    if (tab->unitCount == tab->unitCapacity)
+    {
+        int bytes = tab->unitCapacity * (int)sizeof(ScopeTable);
+        int checkBytes = tab->unitCapacity * (int)sizeof(CheckResult);
+        int shiftBytes = tab->unitCapacity * (int)sizeof(int);
+        tab->units = (ScopeTable*)st_grow(
+            tab->global->table, tab->units, &bytes, bytes ? bytes * 2 : 16 * (int)sizeof(ScopeTable), TableMem);
+        tab->checks = (CheckResult*)st_grow(
+            tab->global->table, tab->checks, &checkBytes, (bytes / (int)sizeof(ScopeTable)) * (int)sizeof(CheckResult), TableMem);
+        tab->shifts = (int*)st_grow(
+            tab->global->table, tab->shifts, &shiftBytes, (bytes / (int)sizeof(ScopeTable)) * (int)sizeof(int), TableMem);
+        tab->unitCapacity = bytes / (int)sizeof(ScopeTable);
+    }
+    __atomic_add_fetch(&unit->refcount, 1, __ATOMIC_RELAXED);
+    tab->checks[tab->unitCount] = NULL;
+    tab->shifts[tab->unitCount] = shift;
+    tab->units[tab->unitCount++] = unit;
+}
+
+int st_declaration_line(Symtab tab, BucketList symbol)
+{
+    int i;
+    for (i = 0; i < tab->unitCount; ++i)
+    {
+        if (tab->units[i] == symbol->scope->table)
+        {
+            return symbol->lineno + tab->shifts[i];
+        }
+    }
+    return symbol->lineno;
+}
+
+void st_set_check(Symtab tab, int index, CheckResult result)
+{
+    if (result)
+    {
+        __atomic_add_fetch(&result->refcount, 1, __ATOMIC_RELAXED);
+    }
+    st_release_check(tab->checks[index]);
+    tab->checks[index] = result;
+}
+
+void st_release_check(CheckResult result)
+{
+    if (result && __atomic_sub_fetch(&result->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        mt_free(result, CheckMem);
+    }
+}
+
+void st_add_extern(ScopeTable unit, char* name, int lineno)
+{
+    if (unit->externCount == unit->externCapacity)
+    {
+        int bytes = unit->externCapacity * (int)sizeof(ExternRef);
+        unit->externs = (ExternRef*)st_grow(
+            unit, unit->externs, &bytes, bytes ? bytes * 2 : 8 * (int)sizeof(ExternRef), TableMem);
+        unit->externCapacity = bytes / (int)sizeof(ExternRef);
+    }
+    unit->externs[unit->externCount].name = st_strdup(unit, name, SymbolNameMem);
+    unit->externs[unit->externCount].lineno = lineno;
+    ++unit->externCount;
+}
+
+Symtab st_retain(Symtab tab)
+{
+    __atomic_add_fetch(&tab->refcount, 1, __ATOMIC_RELAXED);
+    return tab;
+}
+
+void st_release(Symtab tab)
+{
+    int i;
+    if (tab == NULL || __atomic_sub_fetch(&tab->refcount, 1, __ATOMIC_ACQ_REL) != 0)
+    {
+        return;
+    }
+    for (i = 0; i < tab->unitCount; ++i)
+    {
+        st_release_check(tab->checks[i]);
+        releaseTable(tab->units[i]);
+    }
+    /* tab itself lives in the pool of its global scope */
+    releaseTable(tab->global->table);
+}
+
+/* Function probeScope searches a single scope for
+ * name, adding the number of names compared to *probes
+ */
+static BucketList probeScope(ScopeList scope, char* name, int h, int* probes)
+{
+    BucketList l = scope->bucket[h];
+    while (l != NULL)
+    {
+        ++*probes;
+        if (strcmp(name, l->name) == 0)
+            break;
+        l = l->next;
+    }
+    return l;
+}
+
+/* Function findSymbol looks name up in scope and,
+ * if outward, in its ancestors and then in the global
+ * scope of tab (when given). *owner is set to the
+ * scope holding the symbol. The lookup is counted
+ * in counter
+ */
+static BucketList findSymbol(Symtab tab, ScopeList scope, char* name, int outward, ScopeList* owner, ProbeStats* counter)
+{
+    int h = hash(name);
+    int probes = 0, walked = 0;
+    ScopeList s = scope;
+    BucketList l = NULL;
+    while (s)
+    {
+        ++walked;
+        l = probeScope(s, name, h, &probes);
+        if (l || !outward)
+            break;
+        s = s->parent;
+    }
+    if (!l && outward && tab && scope->table != tab->global->table)
+    {
+        s = tab->global;
+        ++walked;
+        l = probeScope(s, name, h, &probes);
+    }
+    if (stats)
+    {
+        countLookup(counter, probes, walked);
+    }
+    if (owner)
+    {
+        *owner = s;
+    }
+    return l;
+}
+
 /* Success: return BucketList, Failure(redefine): return NULL */
 BucketList st_insert(ScopeList scope, char* name, ExpType type, int isarray, SymbolKind kind, int lineno, int loc)
 {
     int h = hash(name);
-    BucketList l = st_lookup_excluding_parent(scope, name);
+    BucketList l = findSymbol(NULL, scope, name, FALSE, NULL, &insertStats);
     if (l)
     {
         return NULL;
     }
 
-    l = (BucketList)malloc(sizeof(struct BucketListRec));
-    l->name = name;
-    l->lines = (LineList)malloc(sizeof(struct LineListRec));
-    l->lines->lineno = lineno;
+    l = (BucketList)st_alloc(scope->table, sizeof(struct BucketListRec), BucketMem);
+    l->name = st_strdup(scope->table, name, SymbolNameMem);
+    l->lineno = lineno;
     l->memloc = loc;
+    l->scope = scope;
     l->type = type;
     l->kind = kind;
     l->isarray = isarray;
-    l->lines->next = NULL;
     l->next = scope->bucket[h];
-    l->functionInfo.args = NULL;
     scope->bucket[h] = l;
     return l;
 } /* st_insert */
 
-/* Success: return 0, Failure(undefined): return -1 */
-int st_insert_lineno(ScopeList scope, char* name, int lineno)
+BucketList st_insert_lineno(Symtab tab, ScopeList scope, char* name, int lineno)
 {
-    int h = hash(name);
-    BucketList l = st_lookup(scope, name);
-    if (!l)
+    ScopeList owner;
+    BucketList l = findSymbol(tab, scope, name, TRUE, &owner, &insertStats);
+    if (!xref)
     {
-        return -1;
+        return l;
     }
-
-    LineList t = l->lines;
-    while (t->next != NULL)
-        t = t->next;
-    t->next = (LineList)malloc(sizeof(struct LineListRec));
-    t->next->lineno = lineno;
-    t->next->next = NULL;
-    return 0;
+    /* a name that is not declared yet may be a global
+     * when the tree is shared with a later version
+     */
+    if (tab && scope->table != tab->global->table && (!l || owner == tab->global))
+    {
+        st_add_extern(scope->table, name, lineno);
+    }
+    if (l)
+    {
+        lines_append(owner->table, &l->lines, lineno);
+    }
+    return l;
 }
 
 /* Function st_lookup returns the memory
@@ -98,33 +507,17 @@ int st_insert_lineno(ScopeList scope, char* name, int lineno)
  */
 BucketList st_lookup(ScopeList scope, char* name)
 {
-    while (scope)
-    {
-        int h = hash(name);
-        BucketList l = scope->bucket[h];
-        while ((l != NULL) && (strcmp(name, l->name) != 0))
-            l = l->next;
-        if (l)
-        {
-            return l;
-        }
-        scope = scope->parent;
-    }
-    return NULL;
+    return findSymbol(NULL, scope, name, TRUE, NULL, &lookupStats);
 }
 
-BucketList st_lookup_excluding_parent(ScopeList scope, char* name)
+BucketList st_resolve(Symtab tab, ScopeList scope, char* name)
 {
-    int h = hash(name);
-    BucketList l = scope->bucket[h];
-    while ((l != NULL) && (strcmp(name, l->name) != 0))
-        l = l->next;
-    if (l)
-    {
-        return l;
-    }
+    return findSymbol(tab, scope, name, TRUE, NULL, &lookupStats);
+}
 
-    return NULL;
+BucketList st_lookup_excluding_parent(ScopeList scope, char* name)
+{
+    return findSymbol(NULL, scope, name, FALSE, NULL, &lookupStats);
 }
 
 /* Procedure printSymTab prints a formatted
@@ -154,18 +547,30 @@ const char* get_variable_type_string(ExpType type, SymbolKind kind, int isarray)
     return variable_type_string[4];
 }
 
-static void symTabTraverse(FILE* listing, ScopeList now, void (*callback)(FILE*, ScopeList))
+/* Procedure symTabTraverse applies callback to root
+ * and its descendants in preorder. They occupy the
+ * ids following root up to the next scope that is
+ * not deeper than root
+ */
+static void symTabTraverse(FILE* listing, ScopeList root, int shift, void (*callback)(FILE*, ScopeList, int))
 {
-    if (now != NULL)
+    ScopeTable table;
+    int i;
+    if (root == NULL)
+    {
+        return;
+    }
+    table = root->table;
+    callback(listing, root, shift);
+    for (i = root->id + 1; i < table->count && table->scopes[i]->depth > root->depth; ++i)
     {
-        callback(listing, now);
-        symTabTraverse(listing, now->sibling, callback);
-        symTabTraverse(listing, now->leftmost, callback);
+        callback(listing, table->scopes[i], shift);
     }
 }
 
-void printSymTabCallback(FILE* listing, ScopeList scope)
+void printSymTabCallback(FILE* listing, ScopeList scope, int shift)
 {
+    char name[101];
     for (int i = 0; i < SIZE; ++i)
     {
         if (scope->bucket[i] != NULL)
@@ -173,15 +578,16 @@ void printSymTabCallback(FILE* listing, ScopeList scope)
             BucketList l = scope->bucket[i];
             while (l != NULL)
             {
-                LineList t = l->lines;
+                LineCursor t;
                 fprintf(listing, "%-14s ", l->name);
                 fprintf(listing, "%-14s ", get_variable_type_string(l->type, l->kind, l->isarray));
-                fprintf(listing, "%-11s ", scope->name);
+                fprintf(listing, "%-11s ", scopeName(scope, shift, name, 100));
                 fprintf(listing, "%-8d ", l->memloc);
-                while (t != NULL)
+                fprintf(listing, "%4d ", l->lineno + shift);
+                st_lines_begin(&t, &l->lines);
+                while (st_lines_next(&t))
                 {
-                    fprintf(listing, "%4d ", t->lineno);
-                    t = t->next;
+                    fprintf(listing, "%4d ", t.lineno + shift);
                 }
                 fprintf(listing, "\n");
                 l = l->next;
@@ -190,17 +596,32 @@ void printSymTabCallback(FILE* listing, ScopeList scope)
     }
 }
 
-void printSymTab(FILE* listing, ScopeList root)
+/* Procedure versionTraverse applies callback to the
+ * global scope and then to the scopes of every
+ * function of tab, in preorder, with the number of
+ * lines the function moved by
+ */
+static void versionTraverse(FILE* listing, Symtab tab, void (*callback)(FILE*, ScopeList, int))
 {
     int i;
+    symTabTraverse(listing, tab->global, 0, callback);
+    for (i = 0; i < tab->unitCount; ++i)
+    {
+        symTabTraverse(listing, tab->units[i]->scopes[0], tab->shifts[i], callback);
+    }
+}
+
+void printSymTab(FILE* listing, Symtab tab)
+{
     fprintf(listing, "\n< Symbol Table >\n");
     fprintf(listing, "Variable Name  Variable Type  Scope Name  Location   Line Numbers\n");
     fprintf(listing, "-------------  -------------  ----------  --------   ------------\n");
-    symTabTraverse(listing, root, printSymTabCallback);
+    versionTraverse(listing, tab, printSymTabCallback);
 } /* printSymTab */
 
-void printFunctionTableCallback(FILE* listing, ScopeList scope)
+void printFunctionTableCallback(FILE* listing, ScopeList scope, int shift)
 {
+    char name[101];
     for (int i = 0; i < SIZE; ++i)
     {
         if (scope->bucket[i] != NULL)
@@ -209,7 +630,7 @@ void printFunctionTableCallback(FILE* listing, ScopeList scope)
             while (l != NULL && l->kind == FuncSymbol)
             {
                 fprintf(listing, "%-14s ", l->name);
-                fprintf(listing, "%-11s ", scope->name);
+                fprintf(listing, "%-11s ", scopeName(scope, shift, name, 100));
                 fprintf(listing, "%-11s ", get_variable_type_string(l->type, VarSymbol, l->isarray));
                 
                 FunctionArgsList arg = l->functionInfo.args;
@@ -233,27 +654,183 @@ void printFunctionTableCallback(FILE* listing, ScopeList scope)
     }
 }
 
-void printFuncTab(FILE* listing, ScopeList root)
+void printFuncTab(FILE* listing, Symtab tab)
 {
-    int i;
     fprintf(listing, "\n< Function Table >\n");
     fprintf(listing, "Function Name  Scope Name  Return Type  Parameter Name   Parameter Type\n");
     fprintf(listing, "-------------  ----------  -----------  --------------   --------------\n");
-    symTabTraverse(listing, root, printFunctionTableCallback);
+    versionTraverse(listing, tab, printFunctionTableCallback);
 } /* printSymTab */
 
 
-void addFuncArg(BucketList func, TreeNode* param)
+void addFuncArg(ScopeList scope, BucketList func, TreeNode* param)
 {
     FunctionArgsList* arg = &func->functionInfo.args;
     while (*arg)
     {
         arg = &(*arg)->next;
     }
-    *arg = (FunctionArgsList)malloc(sizeof(struct FunctionArgsListRec));
-    memset(*arg, 0, sizeof(struct FunctionArgsListRec));
+    *arg = (FunctionArgsList)st_alloc(scope->table, sizeof(struct FunctionArgsListRec), ArgumentMem);
     (*arg)->isarray = param->isarray;
-    (*arg)->name = param->attr.name;
+    (*arg)->name = st_strdup(scope->table, param->attr.name, SymbolNameMem);
     (*arg)->type = param->type;
     ++func->functionInfo.args_count;
-}
\ No newline at end of file
+}
+/* MAXCHAIN is the number of chain lengths that get
+ * a bin of their own in the histogram; longer chains
+ * share the last bin
+ */
+#define MAXCHAIN 8
+
+typedef struct
+{
+    long scopes;
+    long symbols;
+    long chains[MAXCHAIN + 1];
+    long bucketBytes;
+    long lineBytes;
+    long argBytes;
+} TableStats;
+
+static void countScope(TableStats* ts, ScopeList scope)
+{
+    int i;
+    ++ts->scopes;
+    for (i = 0; i < SIZE; ++i)
+    {
+        int length = 0;
+        BucketList l;
+        for (l = scope->bucket[i]; l != NULL; l = l->next)
+        {
+            FunctionArgsList arg;
+            ++length;
+            ts->bucketBytes += sizeof(struct BucketListRec) + strlen(l->name) + 1;
+            ts->lineBytes += l->lines.capacity;
+            for (arg = l->functionInfo.args; arg != NULL; arg = arg->next)
+            {
+                ts->argBytes += sizeof(struct FunctionArgsListRec) + strlen(arg->name) + 1;
+            }
+        }
+        ts->symbols += length;
+        ++ts->chains[length < MAXCHAIN ? length : MAXCHAIN];
+    }
+}
+
+static int countEntries(ScopeList scope)
+{
+    int i, n = 0;
+    BucketList l;
+    for (i = 0; i < SIZE; ++i)
+        for (l = scope->bucket[i]; l != NULL; l = l->next)
+            ++n;
+    return n;
+}
+
+/* Procedure forEachScope applies callback to every
+ * scope of tab in listing order, with the number of
+ * lines its tree moved by
+ */
+static void forEachScope(Symtab tab, void (*callback)(void*, ScopeList, int), void* arg)
+{
+    int i, j;
+    for (j = 0; j < tab->global->table->count; ++j)
+        callback(arg, tab->global->table->scopes[j], 0);
+    for (i = 0; i < tab->unitCount; ++i)
+        for (j = 0; j < tab->units[i]->count; ++j)
+            callback(arg, tab->units[i]->scopes[j], tab->shifts[i]);
+}
+
+static void countScopeCallback(void* arg, ScopeList scope, int shift)
+{
+    (void)shift;
+    countScope((TableStats*)arg, scope);
+}
+
+void st_count(Symtab tab, long* scopes, long* symbols)
+{
+    TableStats ts;
+    memset(&ts, 0, sizeof(ts));
+    forEachScope(tab, countScopeCallback, &ts);
+    *scopes = ts.scopes;
+    *symbols = ts.symbols;
+}
+
+static void printScopeEntries(void* arg, ScopeList scope, int shift)
+{
+    FILE* out = (FILE*)arg;
+    char name[101];
+    fprintf(out, "%-20s %7d\n", scopeName(scope, shift, name, 100), countEntries(scope));
+}
+
+static int firstJsonScope;
+
+static void printScopeEntriesJson(void* arg, ScopeList scope, int shift)
+{
+    FILE* out = (FILE*)arg;
+    char name[101];
+    fprintf(out, "%s\n    {\"name\": \"%s\", \"entries\": %d}",
+            firstJsonScope ? "" : ",",
+            scopeName(scope, shift, name, 100),
+            countEntries(scope));
+    firstJsonScope = FALSE;
+}
+
+static double average(long total, long count)
+{
+    return count ? (double)total / count : 0;
+}
+
+static void printProbeStats(FILE* out, const char* title, const char* what, ProbeStats* counter)
+{
+    fprintf(out, "%s: %ld\n", title, counter->count);
+    fprintf(out, "Probes per %s: avg %.3f  max %ld\n",
+            what, average(counter->probes, counter->count), counter->maxProbes);
+    fprintf(out, "Scopes walked per %s: avg %.3f  max %ld\n",
+            what, average(counter->scopes, counter->count), counter->maxScopes);
+}
+
+static void printProbeStatsJson(FILE* out, const char* key, ProbeStats* counter)
+{
+    fprintf(out, "  \"%s\": {\"count\": %ld, \"avg_probes\": %.3f, \"max_probes\": %ld, "
+                 "\"avg_scopes\": %.3f, \"max_scopes\": %ld},\n",
+            key, counter->count, average(counter->probes, counter->count), counter->maxProbes,
+            average(counter->scopes, counter->count), counter->maxScopes);
+}
+
+void printSymtabStats(FILE* out, Symtab tab, int json)
+{
+    TableStats ts;
+    int i;
+    memset(&ts, 0, sizeof(ts));
+    forEachScope(tab, countScopeCallback, &ts);
+    if (json)
+    {
+        fprintf(out, "{\n  \"scopes\": %ld,\n  \"symbols\": %ld,\n", ts.scopes, ts.symbols);
+        fprintf(out, "  \"scope_entries\": [");
+        firstJsonScope = TRUE;
+        forEachScope(tab, printScopeEntriesJson, out);
+        fprintf(out, "\n  ],\n  \"chain_histogram\": [");
+        for (i = 0; i <= MAXCHAIN; ++i)
+            fprintf(out, "%s%ld", i ? ", " : "", ts.chains[i]);
+        fprintf(out, "],\n");
+        printProbeStatsJson(out, "lookups", &lookupStats);
+        printProbeStatsJson(out, "inserts", &insertStats);
+        fprintf(out, "  \"bytes\": {\"buckets\": %ld, \"line_lists\": %ld, \"argument_lists\": %ld}\n}\n",
+                ts.bucketBytes, ts.lineBytes, ts.argBytes);
+        return;
+    }
+    fprintf(out, "\n< Symbol Table Statistics >\n");
+    fprintf(out, "Scopes: %ld  Symbols: %ld  Buckets per scope: %d\n", ts.scopes, ts.symbols, SIZE);
+    fprintf(out, "\nScope Name           Entries\n");
+    fprintf(out, "----------           -------\n");
+    forEachScope(tab, printScopeEntries, out);
+    fprintf(out, "\nChain Length  Buckets\n");
+    fprintf(out, "------------  -------\n");
+    for (i = 0; i <= MAXCHAIN; ++i)
+        fprintf(out, "%s%-11d %8ld\n", i == MAXCHAIN ? ">=" : "  ", i, ts.chains[i]);
+    fprintf(out, "\n");
+    printProbeStats(out, "Lookups", "lookup", &lookupStats);
+    printProbeStats(out, "Inserts", "insert", &insertStats);
+    fprintf(out, "\nBytes: buckets %ld  line lists %ld  argument lists %ld\n",
+            ts.bucketBytes, ts.lineBytes, ts.argBytes);
+}
@@ -10,17 +10,35 @@
 #define _SYMTAB_H_
 
 #include "globals.h"
+#include "mempool.h"
+#include "memtrack.h"
 
 /* SIZE is the size of the hash table */
 #define SIZE 211
 /* the list of line numbers of the source
- * code in which a variable is referenced
+ * code in which a variable is referenced.
+ * Line numbers are stored as zigzag delta-encoded
+ * varints in a growable byte buffer, so appending
+ * a reference is O(1) amortized
  */
 typedef struct LineListRec
 {
+    unsigned char* bytes;
+    int size;
+    int capacity;
+    int count;
+    int last;
+} LineList;
+
+/* LineCursor walks the line numbers of a LineList
+ * in insertion order
+ */
+typedef struct
+{
+    const LineList* lines;
+    int pos;
     int lineno;
-    struct LineListRec* next;
-} * LineList;
+} LineCursor;
 
 typedef struct FunctionArgsListRec
 {
@@ -42,29 +60,180 @@ typedef struct BucketListRec
     ExpType type;
     int isarray;
     SymbolKind kind;
+    int lineno; /* line of the declaration */
     LineList lines;
-    int memloc;
+    int memloc;                 /* frame offset, or global location */
+    struct ScopeListRec* scope; /* scope of the declaration */
     struct BucketListRec* next;
-    FunctionInfo functionInfo
+    FunctionInfo functionInfo;
 }* BucketList;
 
 
+struct ScopeListRec;
+
+/* a reference from a scope tree to a symbol of
+ * the global scope, or to a name undeclared when
+ * the tree was built, kept so that reference lines
+ * can be replayed when the tree is shared
+ */
+typedef struct
+{
+    char* name;
+    int lineno;
+} ExternRef;
+
+/* a global name a tree resolved while it was type
+ * checked, with the signature it resolved to (0 if
+ * the name was undeclared)
+ */
+typedef struct
+{
+    char* name;
+    unsigned long signature;
+} Dependency;
+
+/* a line number in the text of diagnostics: the
+ * number lineno goes at offset
+ */
+typedef struct
+{
+    int offset;
+    int lineno;
+} DiagLine;
+
+/* the annotations type checking left on an
+ * expression node.
+ * A symbol of the global scope is looked up again
+ * by name, since every version has its own
+ */
+typedef struct
+{
+    BucketList symbol;
+    ExpType type;
+    short isarray;
+    short global; /* symbol is a global */
+} Annotation;
+
+/* CheckResult is what the type check of a function
+ * found: the global names it resolved, the text of
+ * its diagnostics and the annotations of the
+ * expression nodes of the function in preorder. It
+ * holds as long as every dependency resolves to the
+ * same signature. The line numbers are left out of
+ * the text and counted from the first line of the
+ * function, so the result holds wherever the
+ * function moves. A result is one block, immutable
+ * and reference counted, so versions that share the
+ * table of a function share its result as well
+ */
+typedef struct CheckResultRec
+{
+    int refcount;
+    Dependency* deps;
+    int depCount;
+    char* diagnostics;
+    int diagnosticsSize;
+    DiagLine* lines; /* of the diagnostics */
+    int lineCount;
+    Annotation* annotations;
+    int annotationCount;
+}* CheckResult;
+
+/* ScopeTable holds every scope of a tree in a
+ * contiguous array indexed by scope id. Ids are
+ * dense and given in creation order, which is the
+ * preorder of the scope tree.
+ * A table is immutable once built and reference
+ * counted, so the table of a function can be shared
+ * by several versions of the symbol table
+ */
+typedef struct ScopeTableRec
+{
+    MemPool pool;
+    struct ScopeListRec** scopes;
+    int count;
+    int capacity;
+    int refcount;
+    unsigned long hash; /* of the declaration it was built from */
+    int lineno;         /* of that declaration */
+    int clean;          /* built without errors */
+    int xref;           /* built with reference lines */
+    ExternRef* externs;
+    int externCount;
+    int externCapacity;
+    long memBytes[MemKindCount]; /* taken from the pool, by kind */
+}* ScopeTable;
+
+/* every scope of a tree allocates its records
+ * from the pool created with the root scope.
+ * Block scopes have no name until one is asked
+ * for with st_scope_name
+ */
 typedef struct ScopeListRec
 {
     char* name;
+    int id;
+    int depth;
+    int lineno;
+    MemPool pool;
+    ScopeTable table;
     BucketList bucket[SIZE];
     struct ScopeListRec* parent;
     struct ScopeListRec* leftmost;
+    struct ScopeListRec* rightmost;
     struct ScopeListRec* sibling;
 }* ScopeList;
 
+/* Symtab is one version of the symbol tables of a
+ * program: a global scope, one scope table per
+ * function and the result of checking it. Function
+ * tables that did not change between versions are
+ * shared, not copied, and bring the result of their
+ * last check along. A shared table keeps the lines
+ * it was built with; the version adds the number of
+ * lines its function moved by to them. A version is
+ * finished once it is type checked and is never
+ * modified after, so a reader holding a reference
+ * (st_retain) can use it while newer versions are
+ * being built
+ */
+typedef struct SymtabRec
+{
+    int refcount;
+    ScopeList global;
+    ScopeTable* units;
+    CheckResult* checks; /* of units[i], or NULL */
+    int* shifts;         /* lines units[i] moved by */
+    int unitCount;
+    int unitCapacity;
+}* Symtab;
+
 /* Procedure st_insert inserts line numbers and
  * memory locations into the symbol table
  * loc = memory location is inserted only the
  * first time, otherwise ignored
  */
 BucketList st_insert(ScopeList scope, char* name, ExpType type, int isarray, SymbolKind kind, int lineno, int loc);
-int st_insert_lineno(ScopeList scope, char* name, int lineno);
+
+/* Function st_insert_lineno resolves a reference to
+ * name at lineno and returns the declaration, or NULL
+ * if name is undeclared. The line is only recorded
+ * while cross-referencing is enabled
+ */
+BucketList st_insert_lineno(Symtab tab, ScopeList scope, char* name, int lineno);
+
+/* Procedure st_set_xref enables or disables recording
+ * of reference line numbers (off by default)
+ */
+void st_set_xref(int enabled);
+int st_xref_enabled(void);
+
+/* Procedures st_lines_begin and st_lines_next iterate
+ * over the recorded reference lines of a symbol.
+ * st_lines_next returns FALSE when no lines remain
+ */
+void st_lines_begin(LineCursor* cursor, const LineList* lines);
+int st_lines_next(LineCursor* cursor);
 
 /* Function st_lookup returns the memory
  * location of a variable or -1 if not found
@@ -72,15 +241,112 @@ int st_insert_lineno(ScopeList scope, char* name, int lineno);
 BucketList st_lookup(ScopeList scope, char* name);
 BucketList st_lookup_excluding_parent(ScopeList scope, char* name);
 
+/* Function st_resolve looks name up from scope
+ * outwards and then in the global scope of tab
+ */
+BucketList st_resolve(Symtab tab, ScopeList scope, char* name);
+
+/* Function create_ScopeList creates a scope under
+ * parent; a scope without parent starts a new tree
+ * with its own memory pool. name is copied
+ */
 ScopeList create_ScopeList(ScopeList parent, char* name);
 
+/* Function create_BlockScope creates the scope of
+ * a compound statement ending at lineno. Its name
+ * ("<parent>_<lineno>") is built on first use
+ */
+ScopeList create_BlockScope(ScopeList parent, int lineno);
+
+/* Function st_scope_name returns the name of scope.
+ * It caches the name in the scope, so readers that
+ * share a version across threads should format it
+ * with st_format_scope_name instead
+ */
+char* st_scope_name(ScopeList scope);
+void st_format_scope_name(ScopeList scope, char* buf, int size);
+
+/* Functions st_alloc and st_strdup allocate from
+ * the pool of table like pool_alloc and pool_strdup,
+ * and count the bytes as kind for --mem-report
+ */
+void* st_alloc(ScopeTable table, size_t size, MemKind kind);
+char* st_strdup(ScopeTable table, const char* s, MemKind kind);
+
+/* Procedure st_destroy drops a reference to the
+ * table of root, releasing every scope, symbol, line
+ * list and argument list of the tree with the last one
+ */
+void st_destroy(ScopeList root);
+
+/* Function st_create creates a version with an
+ * empty global scope and one reference
+ */
+Symtab st_create(void);
+
+/* Procedure st_add_unit appends the table of a
+ * function to tab, taking a reference to it. shift
+ * is the number of lines the function moved by
+ * since the table was built
+ */
+void st_add_unit(Symtab tab, ScopeTable unit, int shift);
+
+/* Function st_declaration_line returns the line of
+ * the declaration of symbol in tab, moved with the
+ * function it belongs to
+ */
+int st_declaration_line(Symtab tab, BucketList symbol);
+
+/* Procedure st_set_check makes result (or NULL) the
+ * check result of the index-th function table of tab,
+ * taking a reference to it
+ */
+void st_set_check(Symtab tab, int index, CheckResult result);
+
+/* Procedure st_release_check drops a reference to
+ * result and frees it with the last one
+ */
+void st_release_check(CheckResult result);
+
+/* Procedure st_add_extern records that a tree of
+ * unit referenced the global name at lineno
+ */
+void st_add_extern(ScopeTable unit, char* name, int lineno);
+
+/* Function st_retain and procedure st_release take
+ * and drop a reference to a version. The last
+ * release frees the global scope and drops the
+ * version's references to its function tables
+ */
+Symtab st_retain(Symtab tab);
+void st_release(Symtab tab);
+
 /* Procedure printSymTab prints a formatted
  * listing of the symbol table contents
  * to the listing file
  */
-void printSymTab(FILE* listing, ScopeList root);
-void printFuncTab(FILE* listing, ScopeList root);
+void printSymTab(FILE* listing, Symtab tab);
+void printFuncTab(FILE* listing, Symtab tab);
 
-void addFuncArg(BucketList func, TreeNode* param);
+void addFuncArg(ScopeList scope, BucketList func, TreeNode* param);
+
+/* Procedure st_set_stats enables or disables (and
+ * resets) counting of probes and scopes walked by
+ * every lookup. The lookups st_insert and
+ * st_insert_lineno make are counted apart
+ */
+void st_set_stats(int enabled);
+
+/* Procedure st_count stores the number of scopes
+ * and of symbols of tab in *scopes and *symbols
+ */
+void st_count(Symtab tab, long* scopes, long* symbols);
+
+/* Procedure printSymtabStats prints per-scope entry
+ * counts, the bucket chain length histogram, the
+ * costs of lookups and of inserts, and memory used
+ * by tab, as text or as JSON
+ */
+void printSymtabStats(FILE* out, Symtab tab, int json);
 
 #endif
@@ -9,6 +9,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tmb.h"
 
 #ifndef TRUE
     #define TRUE 1
@@ -18,8 +22,6 @@
 #endif
 
 /******* const *******/
-#define IADDR_SIZE 1024 /* increase for large programs */
-#define DADDR_SIZE 1024 /* increase for large programs */
 #define NO_REGS 8
 #define PC_REG 7
 
@@ -35,35 +37,6 @@ typedef enum
     opclRA  /* reg r, int d+s */
 } OPCLASS;
 
-typedef enum
-{
-    /* RR instructions */
-    opHALT,  /* RR     halt, operands are ignored */
-    opIN,    /* RR     read into reg(r); s and t are ignored */
-    opOUT,   /* RR     write from reg(r), s and t are ignored */
-    opADD,   /* RR     reg(r) = reg(s)+reg(t) */
-    opSUB,   /* RR     reg(r) = reg(s)-reg(t) */
-    opMUL,   /* RR     reg(r) = reg(s)*reg(t) */
-    opDIV,   /* RR     reg(r) = reg(s)/reg(t) */
-    opRRLim, /* limit of RR opcodes */
-
-    /* RM instructions */
-    opLD,    /* RM     reg(r) = mem(d+reg(s)) */
-    opST,    /* RM     mem(d+reg(s)) = reg(r) */
-    opRMLim, /* Limit of RM opcodes */
-
-    /* RA instructions */
-    opLDA,  /* RA     reg(r) = d+reg(s) */
-    opLDC,  /* RA     reg(r) = d ; reg(s) is ignored */
-    opJLT,  /* RA     if reg(r)<0 then reg(7) = d+reg(s) */
-    opJLE,  /* RA     if reg(r)<=0 then reg(7) = d+reg(s) */
-    opJGT,  /* RA     if reg(r)>0 then reg(7) = d+reg(s) */
-    opJGE,  /* RA     if reg(r)>=0 then reg(7) = d+reg(s) */
-    opJEQ,  /* RA     if reg(r)==0 then reg(7) = d+reg(s) */
-    opJNE,  /* RA     if reg(r)!=0 then reg(7) = d+reg(s) */
-    opRALim /* Limit of RA opcodes */
-} OPCODE;
-
 typedef enum
 {
     srOKAY,
@@ -73,13 +46,7 @@ typedef enum
     srZERODIVIDE
 } STEPRESULT;
 
-typedef struct
-{
-    int iop;
-    int iarg1;
-    int iarg2;
-    int iarg3;
-} INSTRUCTION;
+typedef TmbInstruction INSTRUCTION;
 
 /******** vars ********/
 int iloc = 0;
@@ -87,7 +54,19 @@ int dloc = 0;
 int traceflag = FALSE;
 int icountflag = FALSE;
 
-INSTRUCTION iMem[IADDR_SIZE];
+/* iMem is read from a text program, or mapped from
+ * a .tmb file with its data, symbols and lines
+ */
+INSTRUCTION* iMem = NULL;
+int iMemSize = 0;
+const int32_t* data = NULL;
+int dataBase = 0;
+int dataCount = 0;
+const TmbSymbol* symbols = NULL;
+int symbolCount = 0;
+const TmbLine* lines = NULL;
+int lineCount = 0;
+const char* strings = NULL;
 int dMem[DADDR_SIZE];
 int reg[NO_REGS];
 
@@ -122,7 +101,7 @@ char* stepResultTab[] = {"OK",
                          "Data Memory Fault",
                          "Division by 0"};
 
-char pgmName[20];
+char* pgmName;
 FILE* pgm;
 
 char in_Line[LINESIZE];
@@ -148,7 +127,7 @@ int opClass(int c)
 void writeInstruction(int loc)
 {
     printf("%5d: ", loc);
-    if ((loc >= 0) && (loc < IADDR_SIZE))
+    if ((loc >= 0) && (loc < iMemSize))
     {
         printf("%6s%3d,", opCodeTab[iMem[loc].iop], iMem[loc].iarg1);
         switch (opClass(iMem[loc].iop))
@@ -174,6 +153,21 @@ void getCh(void)
         ch = ' ';
 } /* getCh */
 
+/********************************************/
+/* reads a line of standard input into in_Line,
+ * without its newline; FALSE at end of input
+ */
+int readLine(void)
+{
+    if (fgets(in_Line, LINESIZE, stdin) == NULL)
+        return FALSE;
+    lineLen = strlen(in_Line);
+    if (lineLen > 0 && in_Line[lineLen - 1] == '\n')
+        in_Line[--lineLen] = '\0';
+    inCol = 0;
+    return TRUE;
+} /* readLine */
+
 /********************************************/
 int nonBlank(void)
 {
@@ -269,23 +263,46 @@ int error(char* msg, int lineNo, int instNo)
 } /* error */
 
 /********************************************/
-int readInstructions(void)
+/* resets registers and data memory, and loads
+ * the data segment of a .tmb program
+ */
+void clearMachine(void)
 {
-    OPCODE op;
-    int arg1, arg2, arg3;
-    int loc, regNo, lineNo;
+    int regNo, loc;
     for (regNo = 0; regNo < NO_REGS; regNo++)
         reg[regNo] = 0;
     dMem[0] = DADDR_SIZE - 1;
     for (loc = 1; loc < DADDR_SIZE; loc++)
         dMem[loc] = 0;
-    for (loc = 0; loc < IADDR_SIZE; loc++)
-    {
-        iMem[loc].iop = opHALT;
-        iMem[loc].iarg1 = 0;
-        iMem[loc].iarg2 = 0;
-        iMem[loc].iarg3 = 0;
-    }
+    for (loc = 0; loc < dataCount; loc++)
+        dMem[dataBase + loc] = data[loc];
+} /* clearMachine */
+
+/********************************************/
+/* grows iMem of a text program to at least size
+ * locations; new locations hold HALT
+ */
+int growInstructions(int size)
+{
+    int newSize = iMemSize ? iMemSize : 1024;
+    INSTRUCTION* grown;
+    while (newSize < size)
+        newSize *= 2;
+    grown = realloc(iMem, newSize * sizeof(INSTRUCTION));
+    if (grown == NULL)
+        return FALSE;
+    memset(grown + iMemSize, 0, (newSize - iMemSize) * sizeof(INSTRUCTION));
+    iMem = grown;
+    iMemSize = newSize;
+    return TRUE;
+} /* growInstructions */
+
+/********************************************/
+int readInstructions(void)
+{
+    OPCODE op;
+    int arg1, arg2, arg3;
+    int loc, lineNo;
     lineNo = 0;
     while (!feof(pgm))
     {
@@ -302,7 +319,7 @@ int readInstructions(void)
             if (!getNum())
                 return error("Bad location", lineNo, -1);
             loc = num;
-            if (loc > IADDR_SIZE)
+            if (loc >= iMemSize && !growInstructions(loc + 1))
                 return error("Location too large", lineNo, loc);
             if (!skipCh(':'))
                 return error("Missing colon", lineNo, loc);
@@ -359,6 +376,89 @@ int readInstructions(void)
     return TRUE;
 } /* readInstructions */
 
+/********************************************/
+int badObject(char* msg, int instNo)
+{
+    printf("%s: ", pgmName);
+    if (instNo >= 0)
+        printf("(Instruction %d) ", instNo);
+    printf("%s\n", msg);
+    return FALSE;
+} /* badObject */
+
+/********************************************/
+/* maps a .tmb program; its instructions are run
+ * where they are mapped, once they are checked
+ */
+int readBinary(void)
+{
+    struct stat st;
+    const TmbHeader* header;
+    const INSTRUCTION* in;
+    long size;
+    int loc;
+    if (fstat(fileno(pgm), &st) != 0 || st.st_size < (long)sizeof(TmbHeader))
+        return badObject("Truncated object file", -1);
+    header = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(pgm), 0);
+    if (header == MAP_FAILED)
+        return badObject("Cannot map object file", -1);
+    if (header->instructionCount < 0 || header->dataCount < 0 || header->symbolCount < 0 ||
+        header->lineCount < 0 || header->stringSize < 0)
+        return badObject("Bad header", -1);
+    size = sizeof(TmbHeader) + (long)header->instructionCount * sizeof(TmbInstruction) +
+           (long)header->dataCount * sizeof(int32_t) + (long)header->symbolCount * sizeof(TmbSymbol) +
+           (long)header->lineCount * sizeof(TmbLine) + header->stringSize;
+    if (size > st.st_size)
+        return badObject("Truncated object file", -1);
+    if (header->dataBase < 0 || header->dataBase + (long)header->dataCount > DADDR_SIZE)
+        return badObject("Data segment out of range", -1);
+    iMem = (INSTRUCTION*)(header + 1);
+    iMemSize = header->instructionCount;
+    data = (const int32_t*)(iMem + iMemSize);
+    dataBase = header->dataBase;
+    dataCount = header->dataCount;
+    symbols = (const TmbSymbol*)(data + dataCount);
+    symbolCount = header->symbolCount;
+    lines = (const TmbLine*)(symbols + symbolCount);
+    lineCount = header->lineCount;
+    strings = (const char*)(lines + lineCount);
+    if (header->stringSize > 0 && strings[header->stringSize - 1] != '\0')
+        return badObject("Unterminated string table", -1);
+    for (loc = 0; loc < symbolCount; loc++)
+        if (symbols[loc].name < 0 || symbols[loc].name >= header->stringSize)
+            return badObject("Bad symbol name", -1);
+    for (loc = 0; loc < iMemSize; loc++)
+    {
+        in = &iMem[loc];
+        if (in->iop < 0 || in->iop >= opRALim || in->iop == opRRLim || in->iop == opRMLim)
+            return badObject("Illegal opcode", loc);
+        if (in->iarg1 < 0 || in->iarg1 >= NO_REGS || in->iarg3 < 0 || in->iarg3 >= NO_REGS ||
+            (opClass(in->iop) == opclRR && (in->iarg2 < 0 || in->iarg2 >= NO_REGS)))
+            return badObject("Bad register", loc);
+    }
+    return TRUE;
+} /* readBinary */
+
+/********************************************/
+/* prints the source line and the function of the
+ * instruction at loc, if the program records them
+ */
+void writeLocation(int loc)
+{
+    int i, line = -1;
+    const char* name = NULL;
+    for (i = 0; i < lineCount && lines[i].loc <= loc; i++)
+        line = lines[i].lineno;
+    for (i = 0; i < symbolCount && symbols[i].loc <= loc; i++)
+        name = strings + symbols[i].name;
+    if (line >= 0)
+        printf("   at line %d", line);
+    if (name != NULL)
+        printf(" in %s", name);
+    if (line >= 0 || name != NULL)
+        printf("\n");
+} /* writeLocation */
+
 /********************************************/
 STEPRESULT stepTM(void)
 {
@@ -368,7 +468,7 @@ STEPRESULT stepTM(void)
     int ok;
 
     pc = reg[PC_REG];
-    if ((pc < 0) || (pc > IADDR_SIZE))
+    if ((pc < 0) || (pc >= iMemSize))
         return srIMEM_ERR;
     reg[PC_REG] = pc + 1;
     currentinstruction = iMem[pc];
@@ -386,7 +486,7 @@ STEPRESULT stepTM(void)
             r = currentinstruction.iarg1;
             s = currentinstruction.iarg3;
             m = currentinstruction.iarg2 + reg[s];
-            if ((m < 0) || (m > DADDR_SIZE))
+            if ((m < 0) || (m >= DADDR_SIZE))
                 return srDMEM_ERR;
             break;
 
@@ -411,11 +511,12 @@ STEPRESULT stepTM(void)
             do
             {
                 printf("Enter value for IN instruction: ");
-                fflush(stdin);
                 fflush(stdout);
-                gets(in_Line);
-                lineLen = strlen(in_Line);
-                inCol = 0;
+                if (!readLine())
+                {
+                    printf("end of input\n");
+                    return srHALT;
+                }
                 ok = getNum();
                 if (!ok)
                     printf("Illegal value\n");
@@ -497,15 +598,12 @@ int doCommand(void)
     int stepcnt = 0, i;
     int printcnt;
     int stepResult;
-    int regNo, loc;
     do
     {
         printf("Enter command: ");
-        fflush(stdin);
         fflush(stdout);
-        gets(in_Line);
-        lineLen = strlen(in_Line);
-        inCol = 0;
+        if (!readLine())
+            return FALSE;
     } while (!getWord());
 
     cmd = word[0];
@@ -604,7 +702,7 @@ int doCommand(void)
                 printf("Instruction locations?\n");
             else
             {
-                while ((iloc >= 0) && (iloc < IADDR_SIZE) && (printcnt > 0))
+                while ((iloc >= 0) && (iloc < iMemSize) && (printcnt > 0))
                 {
                     writeInstruction(iloc);
                     iloc++;
@@ -640,11 +738,7 @@ int doCommand(void)
             iloc = 0;
             dloc = 0;
             stepcnt = 0;
-            for (regNo = 0; regNo < NO_REGS; regNo++)
-                reg[regNo] = 0;
-            dMem[0] = DADDR_SIZE - 1;
-            for (loc = 1; loc < DADDR_SIZE; loc++)
-                dMem[loc] = 0;
+            clearMachine();
             break;
 
         case 'q':
@@ -683,6 +777,8 @@ int doCommand(void)
             }
         }
         printf("%s\n", stepResultTab[stepResult]);
+        if (stepResult > srHALT)
+            writeLocation(iloc);
     }
     return TRUE;
 } /* doCommand */
@@ -691,26 +787,37 @@ int doCommand(void)
 /* E X E C U T I O N   B E G I N S   H E R E */
 /********************************************/
 
-main(int argc, char* argv[])
+int main(int argc, char* argv[])
 {
     if (argc != 2)
     {
         printf("usage: %s <filename>\n", argv[0]);
         exit(1);
     }
+    pgmName = malloc(strlen(argv[1]) + 4);
     strcpy(pgmName, argv[1]);
     if (strchr(pgmName, '.') == NULL)
         strcat(pgmName, ".tm");
-    pgm = fopen(pgmName, "r");
+    pgm = fopen(pgmName, "rb");
     if (pgm == NULL)
     {
         printf("file '%s' not found\n", pgmName);
         exit(1);
     }
 
-    /* read the program */
-    if (!readInstructions())
-        exit(1);
+    /* read the program, text or .tmb */
+    if (fread(word, 1, 4, pgm) == 4 && strncmp(word, TMB_MAGIC, 4) == 0)
+    {
+        if (!readBinary())
+            exit(1);
+    }
+    else
+    {
+        rewind(pgm);
+        if (!readInstructions())
+            exit(1);
+    }
+    clearMachine();
     /* switch input file to terminal */
     /* reset( input ); */
     /* read-eval-print */
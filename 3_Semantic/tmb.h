@@ -0,0 +1,103 @@
+/****************************************************/
+/* File: tmb.h                                      */
+/* The binary object format (.tmb) of the TM        */
+/* machine, written by the code emitter and mapped  */
+/* by the TM simulator                              */
+/****************************************************/
+
+#ifndef _TMB_H_
+#define _TMB_H_
+
+#include <stdint.h>
+
+/* A .tmb file is a header followed by, in order:
+ *
+ *   instructionCount instruction records
+ *   dataCount words, loaded at dMem[dataBase..]
+ *   symbolCount symbol records, by location
+ *   lineCount line records, by location
+ *   stringSize bytes of NUL terminated names
+ *
+ * Every field is a 32-bit integer in the byte order
+ * of the machine that wrote the file, so the
+ * instructions can be run where they are mapped
+ */
+#define TMB_MAGIC "TMB1"
+
+/* the words of data memory of TM; the code
+ * generator lays out frames to fit in it
+ */
+#define DADDR_SIZE 1024 /* increase for large programs */
+
+typedef struct
+{
+    char magic[4];
+    int32_t instructionCount;
+    int32_t dataBase;
+    int32_t dataCount;
+    int32_t symbolCount;
+    int32_t lineCount;
+    int32_t stringSize;
+    int32_t reserved;
+} TmbHeader;
+
+/* the opcodes of TM; the values are those of the
+ * iop field of an instruction record
+ */
+typedef enum
+{
+    /* RR instructions */
+    opHALT,  /* RR     halt, operands are ignored */
+    opIN,    /* RR     read into reg(r); s and t are ignored */
+    opOUT,   /* RR     write from reg(r), s and t are ignored */
+    opADD,   /* RR     reg(r) = reg(s)+reg(t) */
+    opSUB,   /* RR     reg(r) = reg(s)-reg(t) */
+    opMUL,   /* RR     reg(r) = reg(s)*reg(t) */
+    opDIV,   /* RR     reg(r) = reg(s)/reg(t) */
+    opRRLim, /* limit of RR opcodes */
+
+    /* RM instructions */
+    opLD,    /* RM     reg(r) = mem(d+reg(s)) */
+    opST,    /* RM     mem(d+reg(s)) = reg(r) */
+    opRMLim, /* Limit of RM opcodes */
+
+    /* RA instructions */
+    opLDA,  /* RA     reg(r) = d+reg(s) */
+    opLDC,  /* RA     reg(r) = d ; reg(s) is ignored */
+    opJLT,  /* RA     if reg(r)<0 then reg(7) = d+reg(s) */
+    opJLE,  /* RA     if reg(r)<=0 then reg(7) = d+reg(s) */
+    opJGT,  /* RA     if reg(r)>0 then reg(7) = d+reg(s) */
+    opJGE,  /* RA     if reg(r)>=0 then reg(7) = d+reg(s) */
+    opJEQ,  /* RA     if reg(r)==0 then reg(7) = d+reg(s) */
+    opJNE,  /* RA     if reg(r)!=0 then reg(7) = d+reg(s) */
+    opRALim /* Limit of RA opcodes */
+} OPCODE;
+
+/* an instruction: RR instructions use r,s,t in
+ * iarg1..iarg3; RM and RA instructions use r,d,s
+ */
+typedef struct
+{
+    int32_t iop;
+    int32_t iarg1;
+    int32_t iarg2;
+    int32_t iarg3;
+} TmbInstruction;
+
+/* a name, such as a function, placed at loc */
+typedef struct
+{
+    int32_t loc;
+    int32_t name; /* offset in the strings */
+} TmbSymbol;
+
+/* the instructions from loc up to the next record
+ * come from source line lineno
+ */
+typedef struct
+{
+    int32_t loc;
+    int32_t lineno;
+} TmbLine;
+
+#endif
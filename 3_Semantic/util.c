@@ -8,6 +8,7 @@
 
 #include "globals.h"
 #include "util.h"
+#include "memtrack.h"
 #include "y.tab.h"
 
 char* getExpTypeString(TreeNode* node)
@@ -131,7 +132,7 @@ void printToken(TokenType token, const char* tokenString)
  */
 TreeNode* newStmtNode(StmtKind kind)
 {
-    TreeNode* t = (TreeNode*)malloc(sizeof(TreeNode));
+    TreeNode* t = (TreeNode*)mt_malloc(sizeof(TreeNode), NodeMem);
     int i;
     if (t == NULL)
         fprintf(listing, "Out of memory error at line %d\n", lineno);
@@ -144,6 +145,8 @@ TreeNode* newStmtNode(StmtKind kind)
         t->kind.stmt = kind;
         t->lineno = lineno;
         t->isarray = FALSE;
+        t->scope = NULL;
+        t->symbol = NULL;
     }
     return t;
 }
@@ -153,7 +156,7 @@ TreeNode* newStmtNode(StmtKind kind)
  */
 TreeNode* newExpNode(ExpKind kind)
 {
-    TreeNode* t = (TreeNode*)malloc(sizeof(TreeNode));
+    TreeNode* t = (TreeNode*)mt_malloc(sizeof(TreeNode), NodeMem);
     int i;
     if (t == NULL)
         fprintf(listing, "Out of memory error at line %d\n", lineno);
@@ -167,13 +170,15 @@ TreeNode* newExpNode(ExpKind kind)
         t->lineno = lineno;
         t->type = Void;
         t->isarray = FALSE;
+        t->scope = NULL;
+        t->symbol = NULL;
     }
     return t;
 }
 
 TreeNode* newDeclarationNode(DeclarationKind kind)
 {
-    TreeNode* t = (TreeNode*)malloc(sizeof(TreeNode));
+    TreeNode* t = (TreeNode*)mt_malloc(sizeof(TreeNode), NodeMem);
     int i;
     if (t == NULL)
         fprintf(listing, "Out of memory error at line %d\n", lineno);
@@ -186,6 +191,8 @@ TreeNode* newDeclarationNode(DeclarationKind kind)
         t->kind.declaration = kind;
         t->lineno = lineno;
         t->isarray = FALSE;
+        t->scope = NULL;
+        t->symbol = NULL;
     }
     return t;
 }
@@ -199,7 +206,7 @@ char* copyString(char* s)
     if (s == NULL)
         return NULL;
     n = strlen(s) + 1;
-    t = malloc(n);
+    t = (char*)mt_malloc(n, NameMem);
     if (t == NULL)
         fprintf(listing, "Out of memory error at line %d\n", lineno);
     else
@@ -207,6 +214,22 @@ char* copyString(char* s)
     return t;
 }
 
+void freeTree(TreeNode* t)
+{
+    while (t != NULL)
+    {
+        TreeNode* sibling = t->sibling;
+        int i;
+        for (i = 0; i < MAXCHILDREN; i++)
+            freeTree(t->child[i]);
+        if ((t->nodekind == ExpK && (t->kind.exp == VarK || t->kind.exp == CallK)) ||
+            (t->nodekind == DeclarationK && t->kind.declaration != VoidParameterK))
+            mt_free(t->attr.name, NameMem);
+        mt_free(t, NodeMem);
+        t = sibling;
+    }
+}
+
 /* Variable indentno is used by printTree to
  * store current number of spaces to indent
  */
@@ -30,6 +30,11 @@ TreeNode* newDeclarationNode(DeclarationKind);
  */
 char* copyString(char*);
 
+/* Procedure freeTree frees the syntax tree t,
+ * its siblings and the names it holds
+ */
+void freeTree(TreeNode*);
+
 /* procedure printTree prints a syntax tree to the
  * listing file using indentation to indicate subtrees
  */